@@ -27,5 +27,7 @@ bool SAFManager::init(GMainLoop *_mainLoop) {
     mLunaService.init();
     mLunaService.attachToLoop(mainLoop);
     LOG_INFO_SAF(MSGID_FUNCTION_CALL, 0, "After attached to mainloop: %d", __LINE__);
+    // Created now so that its PDM subscription is live before the first request
+    DocumentProviderFactory::createDocumentProvider(StorageType::USB);
     return true;
 }
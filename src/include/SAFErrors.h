@@ -44,6 +44,11 @@ namespace SAFErrors
         FILE_ALREADY_EXISTS,
         NO_ERROR,
         PERMISSION_DENIED,
+        OPERATION_CANCELLED,
+        JOB_NOT_FOUND,
+        INVALID_JOB_STATE,
+        INVALID_CURSOR,
+        FILE_TOO_LARGE,
         SAF_ERROR_NOT_SUPPORTED = 8282,
     };
 
@@ -79,6 +84,11 @@ namespace SAFErrors
         { FILE_ALREADY_EXISTS, "File Exists"},
         { NO_ERROR, "No Error"},
         { PERMISSION_DENIED, "Permission Denied"},
+        { OPERATION_CANCELLED, "Operation Cancelled"},
+        { JOB_NOT_FOUND, "No job exists with given ID"},
+        { INVALID_JOB_STATE, "Operation not allowed in current job state"},
+        { INVALID_CURSOR, "Listing cursor is invalid or expired"},
+        { FILE_TOO_LARGE, "File too large for the destination filesystem"},
         { STORAGE_TYPE_NOT_SUPPORTED, "Operation not permitted"}
     };
 
@@ -94,6 +104,9 @@ namespace SAFErrors
 	        { SAFErrors::INVALID_DEST_PATH, "Invalid Internal Destination Path" },
 	        { SAFErrors::FILE_ALREADY_EXISTS, "Internal File Already Exists" },
 	        { SAFErrors::PERMISSION_DENIED, "Internal File Permission Denied" },
+	        { SAFErrors::OPERATION_CANCELLED, "Internal Operation Cancelled" },
+	        { SAFErrors::INVALID_CURSOR, "Internal Listing Cursor Expired" },
+	        { SAFErrors::FILE_TOO_LARGE, "Internal File Too Large for Destination" },
 	        { SAFErrors::NO_ERROR, "Internal No Error" }
 	    };
 		std::string getInternalErrorString(int errorCode);
@@ -133,7 +146,8 @@ namespace SAFErrors
 	        USB_SUB_STORAGE_NOT_EXISTS,
 	        MORE_ATTACHED_STORAGES_THAN_USB,
 	        DRIVE_NOT_MOUNTED,
-	        USB_DRIVE_ALREADY_EJECTED
+	        USB_DRIVE_ALREADY_EJECTED,
+	        USB_DRIVE_BUSY
 	    };
 
 	    static std::map<int, std::string> mUSBErrorTextTable =
@@ -149,8 +163,12 @@ namespace SAFErrors
 	        { SAFErrors::INVALID_DEST_PATH, "Invalid USB Destination Path" },
 	        { SAFErrors::FILE_ALREADY_EXISTS, "USB File Already Exists" },
 	        { DRIVE_NOT_MOUNTED, "USB Drive Not Mounted"},
+	        { SAFErrors::OPERATION_CANCELLED, "USB Operation Cancelled" },
+	        { SAFErrors::INVALID_CURSOR, "USB Listing Cursor Expired" },
+	        { SAFErrors::FILE_TOO_LARGE, "USB File Too Large for Filesystem" },
 	        { SAFErrors::NO_ERROR, "USB No error" },
-	        { USB_DRIVE_ALREADY_EJECTED, "Drive Already Ejected"}
+	        { USB_DRIVE_ALREADY_EJECTED, "Drive Already Ejected"},
+	        { USB_DRIVE_BUSY, "USB Drive Busy with Transfers"}
 	    };
 
 	    std::string getUSBErrorString(int errorCode);
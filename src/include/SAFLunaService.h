@@ -26,6 +26,8 @@
 #include <stdbool.h>
 #include <pbnjson.h>
 #include "ClientWatch.h"
+#include "TransferManager.h"
+#include "SizeIndex.h"
 
 #ifdef MULTI_SESSION_SUPPORT
 #define REQUEST_BUILDER(OBJ, TYPE, PARAMS, CB) \
@@ -67,10 +69,20 @@ public:
     void onMoveReply(pbnjson::JValue, std::shared_ptr<LSUtils::ClientWatch>);
     bool remove(LSMessage &message);
     void onRemoveReply(pbnjson::JValue, std::shared_ptr<LSUtils::ClientWatch>);
+    bool restore(LSMessage &message);
+    void onRestoreReply(pbnjson::JValue, std::shared_ptr<LSUtils::ClientWatch>);
+    bool emptyTrash(LSMessage &message);
+    void onEmptyTrashReply(pbnjson::JValue, std::shared_ptr<LSUtils::ClientWatch>);
     bool eject(LSMessage &message);
     void onEjectReply(pbnjson::JValue, std::shared_ptr<LSUtils::ClientWatch>);
     bool rename(LSMessage &message);
     void onRenameReply(pbnjson::JValue, std::shared_ptr<LSUtils::ClientWatch>);
+    bool getJobStatus(LSMessage &message);
+    bool cancelJob(LSMessage &message);
+    bool pauseJob(LSMessage &message);
+    bool resumeJob(LSMessage &message);
+    bool listJobs(LSMessage &message);
+    bool getSizeIndexStatus(LSMessage &message);
     void getSubsDropped(void);
     static LSHandle* lsHandle;
 private :
@@ -79,6 +91,8 @@ private :
     void registerService();
     StorageType getStorageDeviceType(pbnjson::JValue jsonObj);
     StorageType getStorageDeviceType(std::string type);
+    std::shared_ptr<TransferJob> getRequestedJob(LS::Message &request);
+    static std::string getSessionId(LS::Message &request);
 };
 #endif /* SRC_LUNA_SAFLUNASERVICE_H_ */
 
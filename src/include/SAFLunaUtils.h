@@ -56,6 +56,8 @@
 #define PROPS_8(p1, p2, p3, p4, p5, p6, p7, p8)       ",\"properties\":{" p1 "," p2 "," p3 "," p4 "," p5 "," p6 "," p7 "," p8 "}"
 #define PROPS_9(p1, p2, p3, p4, p5, p6, p7, p8, p9)   ",\"properties\":{" p1 "," p2 "," p3 "," p4 "," p5 "," p6 "," p7 "," p8 "," p9 "}"
 #define PROPS_10(p1, p2, p3, p4, p5, p6, p7, p8, p9, p10)   ",\"properties\":{" p1 "," p2 "," p3 "," p4 "," p5 "," p6 "," p7 "," p8 "," p9 "," p10"}"
+#define PROPS_11(p1, p2, p3, p4, p5, p6, p7, p8, p9, p10, p11)   ",\"properties\":{" p1 "," p2 "," p3 "," p4 "," p5 "," p6 "," p7 "," p8 "," p9 "," p10 "," p11 "}"
+#define PROPS_12(p1, p2, p3, p4, p5, p6, p7, p8, p9, p10, p11, p12)   ",\"properties\":{" p1 "," p2 "," p3 "," p4 "," p5 "," p6 "," p7 "," p8 "," p9 "," p10 "," p11 "," p12 "}"
 #define REQUIRED_1(p1)                                ",\"required\":[\"" #p1 "\"]"
 #define REQUIRED_2(p1, p2)                            ",\"required\":[\"" #p1 "\",\"" #p2 "\"]"
 #define REQUIRED_3(p1, p2, p3)                        ",\"required\":[\"" #p1 "\",\"" #p2 "\",\"" #p3 "\"]"
@@ -69,6 +71,7 @@
 #define PROP(name, type)                              "\"" #name "\":{\"type\":\"" #type "\"}"
 #define PROP_WITH_VAL_1(name, type, v1)               "\"" #name "\":{\"type\":\"" #type "\", \"enum\": [" #v1 "]}"
 #define PROP_WITH_VAL_2(name, type, v1, v2)           "\"" #name "\":{\"type\":\"" #type "\", \"enum\": [" #v1 ", " #v2 "]}"
+#define PROP_WITH_VAL_3(name, type, v1, v2, v3)       "\"" #name "\":{\"type\":\"" #type "\", \"enum\": [" #v1 ", " #v2 ", " #v3 "]}"
 #define ARRAY(name, type)                             "\"" #name "\":{\"type\":\"array\", \"items\":{\"type\":\"" #type "\"}}"
 #define OBJARRAY(name, objschema)                     "\"" #name "\":{\"type\":\"array\", \"items\": " objschema "}"
 #define OBJSCHEMA_1(param)                            "{\"type\":\"object\",\"properties\":{" param "}}"
@@ -62,7 +62,9 @@ enum class MethodType {
     RENAME_METHOD,
     EXTRA_METHOD,
     ATTACH_METHOD,
-    AUTHENTICATE_METHOD
+    AUTHENTICATE_METHOD,
+    RESTORE_METHOD,
+    EMPTY_TRASH_METHOD
 };
 
 
@@ -59,8 +59,16 @@ void SAFLunaService::registerService()
         LS_CATEGORY_METHOD(copy)
         LS_CATEGORY_METHOD(move)
         LS_CATEGORY_METHOD(remove)
+        LS_CATEGORY_METHOD(restore)
+        LS_CATEGORY_METHOD(emptyTrash)
         LS_CATEGORY_METHOD(eject)
         LS_CATEGORY_METHOD(rename)
+        LS_CATEGORY_METHOD(getJobStatus)
+        LS_CATEGORY_METHOD(cancelJob)
+        LS_CATEGORY_METHOD(pauseJob)
+        LS_CATEGORY_METHOD(resumeJob)
+        LS_CATEGORY_METHOD(listJobs)
+        LS_CATEGORY_METHOD(getSizeIndexStatus)
     LS_CREATE_CATEGORY_END
 
     try
@@ -127,7 +135,9 @@ bool SAFLunaService::list(LSMessage &message)
     pbnjson::JValue requestObj;
     std::string payload;
     int parseError = 0;
-    const std::string schema = STRICT_SCHEMA(PROPS_7(PROP(storageType, string),PROP(driveId, string),PROP(path, string),PROP(limit, integer),PROP(offset, integer),PROP(refreshToken, string),PROP_WITH_VAL_1(refresh, boolean, true))REQUIRED_5(storageType,driveId,path,offset,limit));
+    const std::string schema = STRICT_SCHEMA(PROPS_12(PROP(storageType, string),PROP(driveId, string),PROP(path, string),PROP(limit, integer),PROP(offset, integer),PROP(refreshToken, string),PROP_WITH_VAL_1(refresh, boolean, true),PROP(dirSize, boolean),PROP(cursor, string),
+        PROP_WITH_VAL_3(sortBy, string, "name", "date", "size"),PROP_WITH_VAL_2(sortOrder, string, "asc", "desc"),
+        OBJECT(filter, STRICT_SCHEMA(PROPS_3(PROP(type, string),ARRAY(extensions, string),PROP(name, string)))))REQUIRED_4(storageType,driveId,path,limit));
     if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError))
     {
         const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_JSON_FORMAT);
@@ -142,14 +152,18 @@ bool SAFLunaService::list(LSMessage &message)
     LOG_DEBUG_SAF("listFolderContents : Folder Path : %s", folderPathString.c_str());
     requestObj["offset"].asNumber<int>(offset);
     requestObj["limit"].asNumber<int>(limit);
+    // A cursor carries its own position; offset only starts a listing
+    bool hasCursor = requestObj.hasKey("cursor");
+    bool isOrdered = requestObj.hasKey("sortBy") || requestObj.hasKey("filter");
     if ((storageType.empty()) || (folderPathString.empty()) || (storageIdStr.empty())
-        || (offset < 1) || (offset > 100) || (limit == -1))
+        || (!hasCursor && (offset < 1)) || (limit == -1))
     {
         const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_PARAM);
         LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_PARAM);
         return true;
     }
-    else if(getStorageDeviceType(std::move(storageType)) == StorageType::INVALID)
+    StorageType type = getStorageDeviceType(std::move(storageType));
+    if ((type == StorageType::INVALID) || ((hasCursor || isOrdered) && (type == StorageType::GDRIVE)))
     {
         const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
         LSUtils::respondWithError(request, errorStr, SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
@@ -352,10 +366,11 @@ bool SAFLunaService::copy(LSMessage &message)
     pbnjson::JValue requestObj;
     int parseError = 0;
     std::string payload;
-    const std::string schema = STRICT_SCHEMA(PROPS_10(PROP(srcStorageType, string),
+    const std::string schema = STRICT_SCHEMA(PROPS_11(PROP(srcStorageType, string),
         PROP(srcDriveId, string), PROP(destStorageType, string), PROP(destDriveId, string),
         PROP(srcPath, string), PROP(destPath, string), PROP(srcRefreshToken, string),
-        PROP(destRefreshToken, string), PROP(overwrite, boolean), PROP(subscribe, boolean))
+        PROP(destRefreshToken, string), PROP(overwrite, boolean), PROP(subscribe, boolean),
+        PROP(progressInterval, integer))
         REQUIRED_6(srcStorageType, srcDriveId, destStorageType, destDriveId, srcPath, destPath));
     if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError))
     {
@@ -385,6 +400,15 @@ bool SAFLunaService::copy(LSMessage &message)
     requestObj.put("storageType",srcType);
     std::shared_ptr<RequestData> reqData = std::make_shared<RequestData>();
     REQUEST_BUILDER(reqData, MethodType::COPY_METHOD, requestObj, SAFLunaService::onCopyReply);
+    // The cloud provider cannot pause or cancel a transfer, so it gets no
+    // job and answers once, as before
+    if (reqData->storageType != StorageType::GDRIVE)
+    {
+        // Hand out the job id right away; progress follows as job events
+        std::shared_ptr<TransferJob> job = TransferManager::getInstance().createJob(reqData);
+        pbnjson::JValue respObj = job->toJson();
+        LSUtils::postToClient(request, respObj);
+    }
     mDocumentProviderManager->addRequest(reqData);
     return true;
 }
@@ -418,10 +442,11 @@ bool SAFLunaService::move(LSMessage &message)
     pbnjson::JValue requestObj;
     int parseError = 0;
     std::string payload;
-    const std::string schema = STRICT_SCHEMA(PROPS_10(PROP(srcStorageType, string),
+    const std::string schema = STRICT_SCHEMA(PROPS_11(PROP(srcStorageType, string),
         PROP(srcDriveId, string), PROP(destStorageType, string), PROP(destDriveId, string),
         PROP(srcPath, string), PROP(destPath, string), PROP(srcRefreshToken, string),
-        PROP(destRefreshToken, string), PROP(overwrite, boolean), PROP(subscribe, boolean))
+        PROP(destRefreshToken, string), PROP(overwrite, boolean), PROP(subscribe, boolean),
+        PROP(progressInterval, integer))
         REQUIRED_6(srcStorageType, srcDriveId, destStorageType, destDriveId, srcPath, destPath));
     if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError))
     {
@@ -451,6 +476,15 @@ bool SAFLunaService::move(LSMessage &message)
     requestObj.put("storageType",srcType);
     std::shared_ptr<RequestData> reqData = std::make_shared<RequestData>();
     REQUEST_BUILDER(reqData, MethodType::MOVE_METHOD, requestObj, SAFLunaService::onMoveReply);
+    // The cloud provider cannot pause or cancel a transfer, so it gets no
+    // job and answers once, as before
+    if (reqData->storageType != StorageType::GDRIVE)
+    {
+        // Hand out the job id right away; progress follows as job events
+        std::shared_ptr<TransferJob> job = TransferManager::getInstance().createJob(reqData);
+        pbnjson::JValue respObj = job->toJson();
+        LSUtils::postToClient(request, respObj);
+    }
     mDocumentProviderManager->addRequest(reqData);
     return true;
 }
@@ -484,7 +518,10 @@ bool SAFLunaService::remove(LSMessage &message)
     pbnjson::JValue requestObj;
     int parseError = 0;
     std::string payload;
-    const std::string schema = STRICT_SCHEMA(PROPS_4(PROP(storageType, string), PROP(driveId, string), PROP(path, string), PROP(refreshToken, string))REQUIRED_3(storageType,driveId,path));
+    const std::string schema = STRICT_SCHEMA(PROPS_8(PROP(storageType, string), PROP(driveId, string),
+        PROP(path, string), PROP(refreshToken, string), PROP(detach, boolean), PROP(trash, boolean),
+        PROP(subscribe, boolean), PROP(progressInterval, integer))
+        REQUIRED_3(storageType,driveId,path));
     if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError))
     {
         const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_JSON_FORMAT);
@@ -501,7 +538,10 @@ bool SAFLunaService::remove(LSMessage &message)
         LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_PARAM);
         return true;
     }
-    else if(getStorageDeviceType(std::move(storageTypeString)) == StorageType::INVALID)
+    StorageType type = getStorageDeviceType(std::move(storageTypeString));
+    bool toTrash = requestObj.hasKey("trash") && requestObj["trash"].asBool();
+    // Only local volumes keep a trash
+    if ((type == StorageType::INVALID) || (toTrash && (type != StorageType::INTERNAL) && (type != StorageType::USB)))
     {
         const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
         LSUtils::respondWithError(request, errorStr, SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
@@ -509,6 +549,18 @@ bool SAFLunaService::remove(LSMessage &message)
     }
     std::shared_ptr<RequestData> reqData = std::make_shared<RequestData>();
     REQUEST_BUILDER(reqData, MethodType::REMOVE_METHOD, requestObj, SAFLunaService::onRemoveReply);
+    if (reqData->storageType != StorageType::GDRIVE)
+    {
+        // Only a subscriber gets the job id up front and progress after it;
+        // anyone else gets the one final reply, with the job id in it
+        bool subscribed = requestObj.hasKey("subscribe") && requestObj["subscribe"].asBool();
+        std::shared_ptr<TransferJob> job = TransferManager::getInstance().createJob(reqData, subscribed);
+        if (subscribed)
+        {
+            pbnjson::JValue respObj = job->toJson();
+            LSUtils::postToClient(request, respObj);
+        }
+    }
     mDocumentProviderManager->addRequest(reqData);
     return true;
 }
@@ -535,6 +587,87 @@ void SAFLunaService::onRemoveReply(pbnjson::JValue rootObj, std::shared_ptr<LSUt
     LSUtils::postToClient(subs->getMessage(), respObj);
 }
 
+bool SAFLunaService::restore(LSMessage &message)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    LS::Message request(&message);
+    pbnjson::JValue requestObj;
+    int parseError = 0;
+    const std::string schema = STRICT_SCHEMA(PROPS_4(PROP(storageType, string), PROP(driveId, string),
+        PROP(trashId, string), PROP(path, string))
+        REQUIRED_2(storageType, driveId));
+    if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError))
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_JSON_FORMAT);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_JSON_FORMAT);
+        return true;
+    }
+    // The entry is named by its trash id or by the path it was removed from
+    if (requestObj["driveId"].asString().empty()
+        || (!requestObj.hasKey("trashId") && !requestObj.hasKey("path")))
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_PARAM);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_PARAM);
+        return true;
+    }
+    StorageType type = getStorageDeviceType(requestObj["storageType"].asString());
+    if ((type != StorageType::INTERNAL) && (type != StorageType::USB))
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
+        return true;
+    }
+    std::shared_ptr<RequestData> reqData = std::make_shared<RequestData>();
+    REQUEST_BUILDER(reqData, MethodType::RESTORE_METHOD, requestObj, SAFLunaService::onRestoreReply);
+    mDocumentProviderManager->addRequest(reqData);
+    return true;
+}
+
+void SAFLunaService::onRestoreReply(pbnjson::JValue rootObj, std::shared_ptr<LSUtils::ClientWatch> subs)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    LSUtils::postToClient(subs->getMessage(), rootObj);
+}
+
+bool SAFLunaService::emptyTrash(LSMessage &message)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    LS::Message request(&message);
+    pbnjson::JValue requestObj;
+    int parseError = 0;
+    const std::string schema = STRICT_SCHEMA(PROPS_2(PROP(storageType, string), PROP(driveId, string))
+        REQUIRED_2(storageType, driveId));
+    if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError))
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_JSON_FORMAT);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_JSON_FORMAT);
+        return true;
+    }
+    if (requestObj["driveId"].asString().empty())
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_PARAM);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_PARAM);
+        return true;
+    }
+    StorageType type = getStorageDeviceType(requestObj["storageType"].asString());
+    if ((type != StorageType::INTERNAL) && (type != StorageType::USB))
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
+        return true;
+    }
+    std::shared_ptr<RequestData> reqData = std::make_shared<RequestData>();
+    REQUEST_BUILDER(reqData, MethodType::EMPTY_TRASH_METHOD, requestObj, SAFLunaService::onEmptyTrashReply);
+    mDocumentProviderManager->addRequest(reqData);
+    return true;
+}
+
+void SAFLunaService::onEmptyTrashReply(pbnjson::JValue rootObj, std::shared_ptr<LSUtils::ClientWatch> subs)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    LSUtils::postToClient(subs->getMessage(), rootObj);
+}
+
 bool SAFLunaService::eject(LSMessage &message)
 {
     LOG_DEBUG_SAF("%s", __FUNCTION__);
@@ -654,6 +787,148 @@ void SAFLunaService::onRenameReply(pbnjson::JValue rootObj, std::shared_ptr<LSUt
     LSUtils::postToClient(subs->getMessage(), respObj);
 }
 
+// The session a request comes from, as REQUEST_BUILDER records it for jobs
+std::string SAFLunaService::getSessionId(LS::Message &request)
+{
+#ifdef MULTI_SESSION_SUPPORT
+    const char *sessionId = LSMessageGetSessionId(request.get());
+    return sessionId ? sessionId : "";
+#else
+    return "root";
+#endif
+}
+
+std::shared_ptr<TransferJob> SAFLunaService::getRequestedJob(LS::Message &request)
+{
+    pbnjson::JValue requestObj;
+    int parseError = 0;
+    const std::string schema = STRICT_SCHEMA(PROPS_1(PROP(jobId, string))REQUIRED_1(jobId));
+    if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError))
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_JSON_FORMAT);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_JSON_FORMAT);
+        return nullptr;
+    }
+    std::shared_ptr<TransferJob> job = TransferManager::getInstance().getJob(requestObj["jobId"].asString());
+    // Another session's job is reported as missing, not as forbidden
+    if (job && (job->getSessionId() != getSessionId(request)))
+        job = nullptr;
+    if (!job)
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::JOB_NOT_FOUND);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::JOB_NOT_FOUND);
+    }
+    return job;
+}
+
+bool SAFLunaService::getJobStatus(LSMessage &message)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    LS::Message request(&message);
+    std::shared_ptr<TransferJob> job = getRequestedJob(request);
+    if (!job)
+        return true;
+    pbnjson::JValue respObj = job->toJson();
+    LSUtils::postToClient(request, respObj);
+    return true;
+}
+
+bool SAFLunaService::cancelJob(LSMessage &message)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    LS::Message request(&message);
+    std::shared_ptr<TransferJob> job = getRequestedJob(request);
+    if (!job)
+        return true;
+    if (!job->cancel())
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_JOB_STATE);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_JOB_STATE);
+        return true;
+    }
+    pbnjson::JValue respObj = job->toJson();
+    LSUtils::postToClient(request, respObj);
+    return true;
+}
+
+bool SAFLunaService::pauseJob(LSMessage &message)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    LS::Message request(&message);
+    std::shared_ptr<TransferJob> job = getRequestedJob(request);
+    if (!job)
+        return true;
+    if (!job->pause())
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_JOB_STATE);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_JOB_STATE);
+        return true;
+    }
+    pbnjson::JValue respObj = job->toJson();
+    LSUtils::postToClient(request, respObj);
+    return true;
+}
+
+bool SAFLunaService::resumeJob(LSMessage &message)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    LS::Message request(&message);
+    std::shared_ptr<TransferJob> job = getRequestedJob(request);
+    if (!job)
+        return true;
+    if (!job->resume())
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_JOB_STATE);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_JOB_STATE);
+        return true;
+    }
+    pbnjson::JValue respObj = job->toJson();
+    LSUtils::postToClient(request, respObj);
+    return true;
+}
+
+bool SAFLunaService::listJobs(LSMessage &message)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    LS::Message request(&message);
+    pbnjson::JValue requestObj;
+    int parseError = 0;
+    // A one-shot snapshot; progress of a single job is followed through its events
+    const std::string schema = STRICT_SCHEMA("");
+    if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError))
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_JSON_FORMAT);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_JSON_FORMAT);
+        return true;
+    }
+    pbnjson::JValue respObj = pbnjson::Object();
+    respObj.put("returnValue", true);
+    respObj.put("jobs", TransferManager::getInstance().listJobs(getSessionId(request)));
+    LSUtils::postToClient(request, respObj);
+    return true;
+}
+
+bool SAFLunaService::getSizeIndexStatus(LSMessage &message)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    LS::Message request(&message);
+    pbnjson::JValue requestObj;
+    int parseError = 0;
+    // A one-shot snapshot; callers poll it while a scan is running
+    const std::string schema = STRICT_SCHEMA("");
+    if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError))
+    {
+        const std::string errorStr = SAFErrors::getSAFErrorString(SAFErrors::INVALID_JSON_FORMAT);
+        LSUtils::respondWithError(request, errorStr, SAFErrors::INVALID_JSON_FORMAT);
+        return true;
+    }
+    pbnjson::JValue respObj = pbnjson::Object();
+    respObj.put("returnValue", true);
+    respObj.put("roots", SizeIndex::getInstance().toJson());
+    LSUtils::postToClient(request, respObj);
+    return true;
+}
+
 StorageType SAFLunaService::getStorageDeviceType(pbnjson::JValue jsonObj)
 {
     StorageType storageType = StorageType::INVALID;
@@ -17,15 +17,18 @@
 void GDriveOperation::loadFileIds(std::shared_ptr<GDRIVE::Credential> cred)
 {
     LOG_DEBUG_SAF("%s", __FUNCTION__);
-    mFileIds.clear();
-    mFileIds["/"] = "root";
+    std::map<std::string, std::string> fileIds;
+    fileIds["/"] = "root";
     std::shared_ptr<GDRIVE::Drive> service = std::shared_ptr<GDRIVE::Drive>(new GDRIVE::Drive(cred.get()));
-    getChildren("root", service, "/");
+    getChildren("root", service, "/", fileIds);
     while (service.use_count() != 0)
         service.reset();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFileIds.swap(fileIds);
 }
 
-void GDriveOperation::getChildren (std::string fileId, std::shared_ptr<GDRIVE::Drive> service, std::string parentPath)
+void GDriveOperation::getChildren (std::string fileId, std::shared_ptr<GDRIVE::Drive> service, std::string parentPath,
+    std::map<std::string, std::string>& fileIds)
 {
     LOG_DEBUG_SAF("%s", __FUNCTION__);
     std::vector<GDRIVE::GChildren>childs = service->children().Listall(std::move(fileId));
@@ -35,18 +38,16 @@ void GDriveOperation::getChildren (std::string fileId, std::shared_ptr<GDRIVE::D
        get.add_field("id,title");
        GDRIVE::GFile file = get.execute();
        std::string path = parentPath + file.get_title();
-       mFileIds[path] = file.get_id();
+       fileIds[path] = file.get_id();
        LOG_DEBUG_SAF("getChildren  %s =>>>>:: %s", path.c_str(), file.get_title().c_str());
-       getChildren(file.get_id(), service, (parentPath + file.get_title() + 
-
-
-"/"));
+       getChildren(file.get_id(), service, (parentPath + file.get_title() + "/"), fileIds);
     }
     return;
 }
 
 std::string GDriveOperation::getFileId(std::string path)
 {
+    std::lock_guard<std::mutex> lock(mMutex);
     auto itr = mFileIds.find(path);
     if (itr != mFileIds.end())
         return itr->second;
@@ -56,6 +57,7 @@ std::string GDriveOperation::getFileId(std::string path)
 std::map<std::string, std::string> GDriveOperation::getFileMap(std::string path)
 {
     LOG_DEBUG_SAF("%s", __FUNCTION__);
+    std::lock_guard<std::mutex> lock(mMutex);
     if(path.empty())
         return mFileIds;
     else
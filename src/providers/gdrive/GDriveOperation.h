@@ -14,6 +14,7 @@
 #ifndef _GDRIVE_OPERATION_H_
 #define _GDRIVE_OPERATION_H_
 #include <map>
+#include <mutex>
 #include "gdrive/gdrive.hpp"
 
 
@@ -24,7 +25,9 @@ public:
     std::string getFileId(std::string);
     std::map<std::string, std::string> getFileMap(std::string path);
 private:
+    // Rebuilt off to the side and swapped in, so lookups never wait on the walk
+    std::mutex mMutex;
     std::map<std::string, std::string> mFileIds;
-    void getChildren (std::string, std::shared_ptr<GDRIVE::Drive>, std::string);
+    void getChildren (std::string, std::shared_ptr<GDRIVE::Drive>, std::string, std::map<std::string, std::string>&);
 };
 #endif
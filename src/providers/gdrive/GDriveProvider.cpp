@@ -17,20 +17,18 @@
 #include <future>
 #include "gdrive/gdrive.hpp"
 #include "SAFUtilityOperation.h"
+#include "SAFWorkerPool.h"
+#include "DeviceQueues.h"
 #include "UpnpDiscover.h"
 
-GDriveProvider::GDriveProvider() : mQuit(false)
+GDriveProvider::GDriveProvider()
 {
     LOG_DEBUG_SAF(" GDriveProvider::GDriveProvider : Constructor Created");
-    mDispatcherThread = std::thread(std::bind(&GDriveProvider::dispatchHandler, this));
-    mDispatcherThread.detach();
     insertMimeTypes();
 }
 
 GDriveProvider::~GDriveProvider()
 {
-    mQuit = true;
-    mCondVar.notify_one();
 }
 
 std::string GDriveProvider::generateDriveId()
@@ -39,6 +37,26 @@ std::string GDriveProvider::generateDriveId()
     return (std::string(GDRIVE_NAME) + "_" + std::to_string(++id));
 }
 
+GDriveUserData* GDriveProvider::findUserData(const std::string& driveId, std::string& owner)
+{
+    // Drives are never detached, so the entry outlives the lock
+    std::shared_lock<std::shared_mutex> lock(mStateMutex);
+    auto itr = mDriveIdUserDataMap.find(driveId);
+    if (itr == mDriveIdUserDataMap.end())
+        return nullptr;
+    auto session = mDriveIdSessionMap.find(driveId);
+    owner = (session == mDriveIdSessionMap.end()) ? "" : session->second;
+    return &itr->second;
+}
+
+std::shared_ptr<GDRIVE::Credential> GDriveProvider::getCredential(GDriveUserData& userDataObj)
+{
+    std::lock_guard<std::mutex> lock(userDataObj.mAuthMutex);
+    if (userDataObj.mAuthParam["refresh_token"].empty())
+        return nullptr;
+    return userDataObj.mCred;
+}
+
 void GDriveProvider::setErrorMessage(shared_ptr<ValuePairMap> valueMap, string errorText)
 {
     valueMap->emplace("errorCode", pair<string, DataType>("-1", DataType::NUMBER));
@@ -75,7 +93,16 @@ void GDriveProvider::extraMethod(std::shared_ptr<RequestData> reqData)
     else if ((type == "token") && validateExtraCommand({"clientId", "clientSecret", "refreshToken"}, reqData))
     {
         std::string clientId = reqData->params["operation"]["payload"]["clientId"].asString();
-        if (mClientIdDriveId.find(clientId) == mClientIdDriveId.end())
+        std::string driveId;
+        {
+            std::shared_lock<std::shared_mutex> lock(mStateMutex);
+            auto itr = mClientIdDriveId.find(clientId);
+            if (itr != mClientIdDriveId.end())
+                driveId = itr->second;
+        }
+        std::string owner;
+        GDriveUserData* userData = driveId.empty() ? nullptr : findUserData(driveId, owner);
+        if (!userData)
         {
             respObj.put("returnValue", false);
             respObj.put("errorCode", SAFErrors::INVALID_PARAM);
@@ -83,7 +110,7 @@ void GDriveProvider::extraMethod(std::shared_ptr<RequestData> reqData)
             reqData->cb(respObj, reqData->subs);
             return;
         }
-        if(mDriveIdSessionMap[mClientIdDriveId[clientId]] != reqData->sessionId)
+        if(owner != reqData->sessionId)
         {
             respObj.put("returnValue", false);
             respObj.put("errorCode", SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
@@ -91,16 +118,21 @@ void GDriveProvider::extraMethod(std::shared_ptr<RequestData> reqData)
             reqData->cb(respObj, reqData->subs);
             return;
         }
-        GDriveUserData& userDataObj = mDriveIdUserDataMap[mClientIdDriveId[clientId]];
-        userDataObj.mAuthParam["client_id"] = reqData->params["operation"]["payload"]["clientId"].asString();
-        userDataObj.mAuthParam["client_secret"] = reqData->params["operation"]["payload"]["clientSecret"].asString();
-        userDataObj.mAuthParam["refresh_token"] = reqData->params["operation"]["payload"]["refreshToken"].asString();
-        while (userDataObj.mCred.use_count() != 0)
-            userDataObj.mCred.reset();
-        userDataObj.mCred = std::shared_ptr<GDRIVE::Credential>(new GDRIVE::Credential(&userDataObj.mAuthParam));
+        GDriveUserData& userDataObj = *userData;
+        std::shared_ptr<GDRIVE::Credential> cred;
+        {
+            std::lock_guard<std::mutex> authLock(userDataObj.mAuthMutex);
+            userDataObj.mAuthParam["client_id"] = reqData->params["operation"]["payload"]["clientId"].asString();
+            userDataObj.mAuthParam["client_secret"] = reqData->params["operation"]["payload"]["clientSecret"].asString();
+            userDataObj.mAuthParam["refresh_token"] = reqData->params["operation"]["payload"]["refreshToken"].asString();
+            while (userDataObj.mCred.use_count() != 0)
+                userDataObj.mCred.reset();
+            userDataObj.mCred = std::shared_ptr<GDRIVE::Credential>(new GDRIVE::Credential(&userDataObj.mAuthParam));
+            cred = userDataObj.mCred;
+        }
         respObj.put("returnValue", true);
         reqData->cb(std::move(respObj), reqData->subs);
-        userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+        userDataObj.mGDriveOperObj.loadFileIds(cred);
     }
     else
     {
@@ -118,20 +150,23 @@ void GDriveProvider::attachCloud(std::shared_ptr<RequestData> reqData)
     std::string authURL;
     std::string clientId = reqData->params["operation"]["payload"]["clientId"].asString();
     std::string clientSecret = reqData->params["operation"]["payload"]["clientSecret"].asString();
+    std::unique_lock<std::shared_mutex> lock(mStateMutex);
     if (mClientIdDriveId.find(clientId) == mClientIdDriveId.end())
     {
         mClientIdDriveId[clientId] = generateDriveId();
         mDriveIdSessionMap[mClientIdDriveId[clientId]] = reqData->sessionId;
-        GDriveUserData userDataObj;
+        // Built in place: the entry holds a mutex and stays put once inserted
+        GDriveUserData& userDataObj = mDriveIdUserDataMap[mClientIdDriveId[clientId]];
         userDataObj.mAuthParam["client_id"] = clientId;
         userDataObj.mAuthParam["client_secret"] = clientSecret;
+        lock.unlock();
         GDRIVE::OAuth oauth(clientId, clientSecret);
         authURL = oauth.get_authorize_url();
-        mDriveIdUserDataMap[mClientIdDriveId[clientId]] = std::move(userDataObj);
         LOG_DEBUG_SAF("attachCloud :client_id = [ %s ]   client_secret = [ %s ]", clientId.c_str(), clientSecret.c_str());
     }
     else
     {
+        lock.unlock();
         respObj.put("returnValue", false);
         respObj.put("errorCode", SAFErrors::CloudErrors::ALREADY_AUTHENTICATED);
         respObj.put("errorText", SAFErrors::CloudErrors::getCloudErrorString(SAFErrors::CloudErrors::ALREADY_AUTHENTICATED));
@@ -166,42 +201,49 @@ void GDriveProvider::authenticateCloud(std::shared_ptr<RequestData> reqData)
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
     pbnjson::JValue respObj = pbnjson::Object();
     std::string driveId = reqData->params["driveId"].asString();
-    if(mDriveIdUserDataMap.find(driveId) == mDriveIdUserDataMap.end())
+    std::string owner;
+    GDriveUserData* userData = findUserData(driveId, owner);
+    if(!userData)
     {
         respObj.put("errorCode", SAFErrors::INVALID_PARAM);
         respObj.put("errorText", "Invalid DriveID");
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    GDriveUserData& userDataObj = mDriveIdUserDataMap[driveId];
+    GDriveUserData& userDataObj = *userData;
+    // Held across the token exchange; only requests on this drive wait for it
+    std::unique_lock<std::mutex> authLock(userDataObj.mAuthMutex);
     userDataObj.mAuthParam["access_token"] = reqData->params["operation"]["payload"]["secretToken"].asString();
     LOG_DEBUG_SAF("authenticateCloud :client_id = [ %s ]   client_secret = [ %s ]   secret_token = [ %s ]", 
         userDataObj.mAuthParam["client_id"].c_str(), userDataObj.mAuthParam["client_secret"].c_str(), userDataObj.mAuthParam["access_token"].c_str());
     while (userDataObj.mCred.use_count() != 0)
         userDataObj.mCred.reset();
     userDataObj.mCred = std::shared_ptr<GDRIVE::Credential>(new GDRIVE::Credential(&userDataObj.mAuthParam));
+    std::shared_ptr<GDRIVE::Credential> cred = userDataObj.mCred;
     LOG_DEBUG_SAF("authenticateCloudTest 1");
     GDRIVE::OAuth oauth(userDataObj.mAuthParam["client_id"], userDataObj.mAuthParam["client_secret"]);
     LOG_DEBUG_SAF("authenticateCloudTest 2");
 
     if (!userDataObj.mAuthParam["access_token"].empty()
-        && oauth.build_credential(userDataObj.mAuthParam["access_token"], *(userDataObj.mCred.get())))
+        && oauth.build_credential(userDataObj.mAuthParam["access_token"], *(cred.get())))
     {
         pbnjson::JValue responsePayObjArr = pbnjson::Array();
         pbnjson::JValue responsePayObj = pbnjson::Object();
         pbnjson::JValue payloadObj = pbnjson::Object();
         payloadObj.put("response", userDataObj.mAuthParam["refresh_token"]);
+        authLock.unlock();
         responsePayObj.put("type", reqData->params["operation"]["type"].asString());
         responsePayObj.put("payload", payloadObj);
         responsePayObjArr.append(responsePayObj);
         respObj.put("returnValue", true);
         respObj.put("responsePayload", responsePayObjArr);
         reqData->cb(respObj, reqData->subs);
-        userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+        userDataObj.mGDriveOperObj.loadFileIds(cred);
         return;
     }
     else
     {
+        authLock.unlock();
         respObj.put("returnValue", false);
         respObj.put("errorCode", SAFErrors::CloudErrors::INVALID_URL);
         respObj.put("errorText", SAFErrors::CloudErrors::getCloudErrorString(SAFErrors::CloudErrors::INVALID_URL));
@@ -214,14 +256,16 @@ void GDriveProvider::list(std::shared_ptr<RequestData> reqData)
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
     pbnjson::JValue respObj = pbnjson::Object();
     std::string driveId = reqData->params["driveId"].asString();
-    if(mDriveIdUserDataMap.find(driveId) == mDriveIdUserDataMap.end())
+    std::string owner;
+    GDriveUserData* userData = findUserData(driveId, owner);
+    if(!userData)
     {
         respObj.put("errorCode", SAFErrors::INVALID_PARAM);
         respObj.put("errorText", "Invalid DriveID");
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    if(mDriveIdSessionMap[driveId] != reqData->sessionId)
+    if(owner != reqData->sessionId)
     {
         respObj.put("returnValue", false);
         respObj.put("errorCode", SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
@@ -232,8 +276,9 @@ void GDriveProvider::list(std::shared_ptr<RequestData> reqData)
     std::string path = reqData->params["path"].asString();
     int limit = reqData->params["limit"].asNumber<int>();
     int offset = reqData->params["offset"].asNumber<int>();
-    GDriveUserData &userDataObj = mDriveIdUserDataMap[driveId];
-    if (userDataObj.mAuthParam["refresh_token"].empty())
+    GDriveUserData &userDataObj = *userData;
+    std::shared_ptr<GDRIVE::Credential> cred = getCredential(userDataObj);
+    if (!cred)
     {
         respObj.put("returnValue", false);
         respObj.put("errorCode", SAFErrors::CloudErrors::AUTHENTICATION_NOT_DONE);
@@ -241,11 +286,11 @@ void GDriveProvider::list(std::shared_ptr<RequestData> reqData)
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+    userDataObj.mGDriveOperObj.loadFileIds(cred);
     std::string folderpathId = userDataObj.mGDriveOperObj.getFileId(path);
     if (!folderpathId.empty())
     {
-        GDRIVE::Drive service(userDataObj.mCred.get());
+        GDRIVE::Drive service(cred.get());
         pbnjson::JValue contentsObj = pbnjson::Array();
         auto fileIdsMap = userDataObj.mGDriveOperObj.getFileMap(path);
         int start = (offset > (int)fileIdsMap.size())?(fileIdsMap.size() + 1):(offset - 1);
@@ -302,14 +347,16 @@ void GDriveProvider::getProperties(std::shared_ptr<RequestData> reqData)
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
     pbnjson::JValue respObj = pbnjson::Object();
     std::string driveId = reqData->params["driveId"].asString();
-    if(mDriveIdUserDataMap.find(driveId) == mDriveIdUserDataMap.end())
+    std::string owner;
+    GDriveUserData* userData = findUserData(driveId, owner);
+    if(!userData)
     {
         respObj.put("errorCode", SAFErrors::INVALID_PARAM);
         respObj.put("errorText", "Invalid DriveID");
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    if(mDriveIdSessionMap[driveId] != reqData->sessionId)
+    if(owner != reqData->sessionId)
     {
         respObj.put("returnValue", false);
         respObj.put("errorCode", SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
@@ -317,8 +364,9 @@ void GDriveProvider::getProperties(std::shared_ptr<RequestData> reqData)
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    GDriveUserData &userDataObj = mDriveIdUserDataMap[driveId];
-    if (userDataObj.mAuthParam["refresh_token"].empty())
+    GDriveUserData &userDataObj = *userData;
+    std::shared_ptr<GDRIVE::Credential> cred = getCredential(userDataObj);
+    if (!cred)
     {
         respObj.put("returnValue", false);
         respObj.put("errorCode", SAFErrors::CloudErrors::AUTHENTICATION_NOT_DONE);
@@ -332,7 +380,7 @@ void GDriveProvider::getProperties(std::shared_ptr<RequestData> reqData)
         path = reqData->params["path"].asString();
         path = userDataObj.mGDriveOperObj.getFileId(path);
     }
-    GDRIVE::Drive service(userDataObj.mCred.get());
+    GDRIVE::Drive service(cred.get());
     GDRIVE::FileGetRequest get = service.files().Get(path);
     get.add_field("userPermission");
     GDRIVE::GFile file = get.execute();
@@ -384,14 +432,16 @@ void GDriveProvider::copy(std::shared_ptr<RequestData> reqData)
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    if(mDriveIdUserDataMap.find(driveId) == mDriveIdUserDataMap.end())
+    std::string owner;
+    GDriveUserData* userData = findUserData(driveId, owner);
+    if(!userData)
     {
         respObj.put("errorCode", SAFErrors::INVALID_PARAM);
         respObj.put("errorText", "Invalid DriveID");
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    if(mDriveIdSessionMap[driveId] != reqData->sessionId)
+    if(owner != reqData->sessionId)
     {
         respObj.put("returnValue", false);
         respObj.put("errorCode", SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
@@ -399,8 +449,9 @@ void GDriveProvider::copy(std::shared_ptr<RequestData> reqData)
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    GDriveUserData &userDataObj = mDriveIdUserDataMap[driveId];
-    if (userDataObj.mAuthParam["refresh_token"].empty())
+    GDriveUserData &userDataObj = *userData;
+    std::shared_ptr<GDRIVE::Credential> cred = getCredential(userDataObj);
+    if (!cred)
     {
         LOG_DEBUG_SAF("===> Authentication Not Done");
         respObj.put("returnValue", false);
@@ -411,7 +462,7 @@ void GDriveProvider::copy(std::shared_ptr<RequestData> reqData)
     }
     std::string srcFileID = userDataObj.mGDriveOperObj.getFileId(srcPath);
     std::string destFileId = userDataObj.mGDriveOperObj.getFileId(destPath);
-    GDRIVE::Drive service(userDataObj.mCred.get());
+    GDRIVE::Drive service(cred.get());
     if (destStorageType== "cloud")
     {
         if (srcStorageType == "cloud")
@@ -432,7 +483,7 @@ void GDriveProvider::copy(std::shared_ptr<RequestData> reqData)
                 respObj.put("returnValue", true);
                 respObj.put("progress", 100);
                 reqData->cb(respObj, reqData->subs);
-                userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+                userDataObj.mGDriveOperObj.loadFileIds(cred);
                 return;
             }
             else
@@ -482,7 +533,7 @@ void GDriveProvider::copy(std::shared_ptr<RequestData> reqData)
             respObj.put("returnValue", true);
             respObj.put("progress", 100);
             reqData->cb(respObj, reqData->subs);
-            userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+            userDataObj.mGDriveOperObj.loadFileIds(cred);
             return;
         }
     }
@@ -511,7 +562,7 @@ void GDriveProvider::copy(std::shared_ptr<RequestData> reqData)
         if (url == "") {
             url = downloadFile.get_exportLinks()["application/pdf"];
         }
-        GDRIVE::CredentialHttpRequest request(userDataObj.mCred.get(), std::move(url), GDRIVE::RM_GET);
+        GDRIVE::CredentialHttpRequest request(cred.get(), std::move(url), GDRIVE::RM_GET);
         GDRIVE::HttpResponse resp = request.request();
         ofstream fout(destPath.c_str(), std::ios::binary);
         if(!fout.good()) {
@@ -526,7 +577,7 @@ void GDriveProvider::copy(std::shared_ptr<RequestData> reqData)
         respObj.put("returnValue", true);
         respObj.put("progress", 100);
         reqData->cb(respObj, reqData->subs);
-        userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+        userDataObj.mGDriveOperObj.loadFileIds(cred);
         return;
     }
     reqData->cb(std::move(respObj), reqData->subs);
@@ -563,14 +614,16 @@ void GDriveProvider::move(std::shared_ptr<RequestData> reqData)
     if(reqData->params.hasKey("subscribe"))
         bool subscribe = reqData->params["subscribe"].asBool();
 
-    if(mDriveIdUserDataMap.find(driveId) == mDriveIdUserDataMap.end())
+    std::string owner;
+    GDriveUserData* userData = findUserData(driveId, owner);
+    if(!userData)
     {
         respObj.put("errorCode", SAFErrors::INVALID_PARAM);
         respObj.put("errorText", "Invalid DriveID");
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    if(mDriveIdSessionMap[driveId] != reqData->sessionId)
+    if(owner != reqData->sessionId)
     {
         respObj.put("returnValue", false);
         respObj.put("errorCode", SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
@@ -578,9 +631,10 @@ void GDriveProvider::move(std::shared_ptr<RequestData> reqData)
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    GDriveUserData &userDataObj = mDriveIdUserDataMap[driveId];
+    GDriveUserData &userDataObj = *userData;
 
-    if (userDataObj.mAuthParam["refresh_token"].empty())
+    std::shared_ptr<GDRIVE::Credential> cred = getCredential(userDataObj);
+    if (!cred)
     {
         LOG_DEBUG_SAF("===> Authentication Not Done");
         respObj.put("returnValue", false);
@@ -591,7 +645,7 @@ void GDriveProvider::move(std::shared_ptr<RequestData> reqData)
     }
     std::string srcFileID = userDataObj.mGDriveOperObj.getFileId(srcPath);
     std::string destFileId = userDataObj.mGDriveOperObj.getFileId(destPath);
-    GDRIVE::Drive service(userDataObj.mCred.get());
+    GDRIVE::Drive service(cred.get());
     if (destStorageType== "cloud")
     {
         if (srcStorageType == "cloud")
@@ -613,7 +667,7 @@ void GDriveProvider::move(std::shared_ptr<RequestData> reqData)
                 respObj.put("returnValue", true);
                 respObj.put("progress", 100);
                 reqData->cb(respObj, reqData->subs);
-                userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+                userDataObj.mGDriveOperObj.loadFileIds(cred);
                 return;
             }
             else
@@ -663,7 +717,7 @@ void GDriveProvider::move(std::shared_ptr<RequestData> reqData)
             auto intObj = InternalRemove(std::move(srcPath));
             (void)intObj;
             reqData->cb(respObj, reqData->subs);
-            userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+            userDataObj.mGDriveOperObj.loadFileIds(cred);
         return;
         }
     }
@@ -692,7 +746,7 @@ void GDriveProvider::move(std::shared_ptr<RequestData> reqData)
         if (url == "") {
             url = downloadFile.get_exportLinks()["application/pdf"];
         }
-        GDRIVE::CredentialHttpRequest request(userDataObj.mCred.get(), std::move(url), GDRIVE::RM_GET);
+        GDRIVE::CredentialHttpRequest request(cred.get(), std::move(url), GDRIVE::RM_GET);
         GDRIVE::HttpResponse resp = request.request();
         ofstream fout(destPath.c_str(), std::ios::binary);
         if(!fout.good()) {
@@ -708,7 +762,7 @@ void GDriveProvider::move(std::shared_ptr<RequestData> reqData)
         respObj.put("returnValue", true);
         respObj.put("progress", 100);
         reqData->cb(respObj, reqData->subs);
-        userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+        userDataObj.mGDriveOperObj.loadFileIds(cred);
         return;
     }
     reqData->cb(std::move(respObj), reqData->subs);
@@ -720,14 +774,16 @@ void GDriveProvider::remove(std::shared_ptr<RequestData> reqData)
     std::string path = reqData->params["path"].asString();
     pbnjson::JValue respObj = pbnjson::Object();
     std::string driveId = reqData->params["driveId"].asString();
-    if(mDriveIdUserDataMap.find(driveId) == mDriveIdUserDataMap.end())
+    std::string owner;
+    GDriveUserData* userData = findUserData(driveId, owner);
+    if(!userData)
     {
         respObj.put("errorCode", SAFErrors::INVALID_PARAM);
         respObj.put("errorText", "Invalid DriveID");
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    if(mDriveIdSessionMap[driveId] != reqData->sessionId)
+    if(owner != reqData->sessionId)
     {
         respObj.put("returnValue", false);
         respObj.put("errorCode", SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
@@ -735,9 +791,10 @@ void GDriveProvider::remove(std::shared_ptr<RequestData> reqData)
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    GDriveUserData &userDataObj = mDriveIdUserDataMap[driveId];
+    GDriveUserData &userDataObj = *userData;
 
-    if (userDataObj.mAuthParam["refresh_token"].empty())
+    std::shared_ptr<GDRIVE::Credential> cred = getCredential(userDataObj);
+    if (!cred)
     {
         LOG_DEBUG_SAF("===> Authentication Not Done");
         respObj.put("returnValue", false);
@@ -751,12 +808,12 @@ void GDriveProvider::remove(std::shared_ptr<RequestData> reqData)
     LOG_DEBUG_SAF("========>FileID:%s", fileId.c_str());
     if (!fileId.empty())
     {
-        GDRIVE::Drive service(userDataObj.mCred.get());
+        GDRIVE::Drive service(cred.get());
         service.files().Delete(std::move(fileId)).execute();
         respObj.put("returnValue", true);
         respObj.put("status", "File Deleted");
         reqData->cb(respObj, reqData->subs);
-        userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+        userDataObj.mGDriveOperObj.loadFileIds(cred);
         return;
     }
     else
@@ -773,14 +830,16 @@ void GDriveProvider::rename(std::shared_ptr<RequestData> reqData)
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
     pbnjson::JValue respObj = pbnjson::Object();
     std::string driveId = reqData->params["driveId"].asString();
-    if(mDriveIdUserDataMap.find(driveId) == mDriveIdUserDataMap.end())
+    std::string owner;
+    GDriveUserData* userData = findUserData(driveId, owner);
+    if(!userData)
     {
         respObj.put("errorCode", SAFErrors::INVALID_PARAM);
         respObj.put("errorText", "Invalid DriveID");
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    if(mDriveIdSessionMap[driveId] != reqData->sessionId)
+    if(owner != reqData->sessionId)
     {
         respObj.put("returnValue", false);
         respObj.put("errorCode", SAFErrors::STORAGE_TYPE_NOT_SUPPORTED);
@@ -788,9 +847,10 @@ void GDriveProvider::rename(std::shared_ptr<RequestData> reqData)
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    GDriveUserData &userDataObj = mDriveIdUserDataMap[driveId];
+    GDriveUserData &userDataObj = *userData;
 
-    if (userDataObj.mAuthParam["refresh_token"].empty())
+    std::shared_ptr<GDRIVE::Credential> cred = getCredential(userDataObj);
+    if (!cred)
     {
         LOG_DEBUG_SAF("===> Authentication Not Done");
         respObj.put("returnValue", false);
@@ -804,12 +864,12 @@ void GDriveProvider::rename(std::shared_ptr<RequestData> reqData)
     {
         GDRIVE::GFile patchFile;
         patchFile.set_title(reqData->params["newName"].asString());
-        GDRIVE::Drive service(userDataObj.mCred.get());
+        GDRIVE::Drive service(cred.get());
         service.files().Patch(std::move(fileId), &patchFile).execute();
         respObj.put("returnValue", true);
         respObj.put("status", "File Renamed");
         reqData->cb(respObj, reqData->subs);
-        userDataObj.mGDriveOperObj.loadFileIds(userDataObj.mCred);
+        userDataObj.mGDriveOperObj.loadFileIds(cred);
         return;
     }
     else
@@ -826,13 +886,16 @@ void GDriveProvider::listStoragesMethod(std::shared_ptr<RequestData> reqData)
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
     pbnjson::JValue respObj = pbnjson::Object();
     pbnjson::JValue gdriveResArr = pbnjson::Array();
-    for (auto & entry : mDriveIdSessionMap)
     {
-        pbnjson::JValue gdriveRes = pbnjson::Object();
-        gdriveRes.put("driveName", GDRIVE_NAME);
-        gdriveRes.put("driveId", entry.first);
-        gdriveRes.put("path", "/");
-        gdriveResArr.append(gdriveRes);
+        std::shared_lock<std::shared_mutex> lock(mStateMutex);
+        for (auto & entry : mDriveIdSessionMap)
+        {
+            pbnjson::JValue gdriveRes = pbnjson::Object();
+            gdriveRes.put("driveName", GDRIVE_NAME);
+            gdriveRes.put("driveId", entry.first);
+            gdriveRes.put("path", "/");
+            gdriveResArr.append(gdriveRes);
+        }
     }
     respObj.put("cloud", gdriveResArr);
     reqData->params.put("response", respObj);
@@ -989,81 +1052,72 @@ string GDriveProvider::getFileID(GDRIVE::Drive service, const vector<string>& fi
 
 void GDriveProvider::addRequest(std::shared_ptr<RequestData>& reqData)
 {
-    LOG_DEBUG_SAF("GDriveProvider :: Entering function %s", __FUNCTION__);
-    {
-        std::unique_lock < std::mutex > lock(mMutex);
-        mQueue.push_back(std::move(reqData));
-    }
-    mCondVar.notify_one();
-
+    std::shared_ptr<RequestData> request = std::move(reqData);
+    // A transfer onto a stick shares the stick's queue with the USB provider
+    DeviceQueues::getInstance().submit(DeviceQueues::getUSBDevices(request), SAFWorkerPool::getLane(request),
+        [this, request]() { handleRequests(request); });
 }
 
 void GDriveProvider::handleRequests(std::shared_ptr<RequestData> reqData)
 {
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
+    // Requests run concurrently on the shared pool. mStateMutex is taken only
+    // around lookups and inserts in the drive maps, never across a cloud call;
+    // credentials are guarded per drive by mAuthMutex.
     switch(reqData->methodType)
     {
         case MethodType::EXTRA_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::EXTRA_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->extraMethod(reqData); });
-            (void)fut;
+            extraMethod(reqData);
         }
         break;
         case MethodType::LIST_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::GET_PROP_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->list(reqData); });
-            (void)fut;
+            list(reqData);
         }
         break;
         case MethodType::GET_PROP_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::GET_PROP_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->getProperties(reqData); });
-            (void)fut;
+            getProperties(reqData);
         }
         break;
         case MethodType::REMOVE_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::REMOVE_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->remove(reqData); });
-            (void)fut;
+            remove(reqData);
         }
         break;
         case MethodType::MOVE_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::MOVE_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->move(reqData); });
-            (void)fut;
+            move(reqData);
         }
         break;
         case MethodType::COPY_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::COPY_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->copy(reqData); });
-            (void)fut;
+            copy(reqData);
         }
         break;
         case MethodType::RENAME_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::RENAME_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->rename(reqData); });
-            (void)fut;
+            rename(reqData);
         }
         break;
         case MethodType::LIST_STORAGES_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::LIST_STORAGES_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->listStoragesMethod(reqData); });
-            (void)fut;
+            listStoragesMethod(reqData);
         }
         break;
         case MethodType::EJECT_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::EJECT_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->eject(reqData); });
-            (void)fut;
+            eject(reqData);
         }
         break;
         default:
@@ -1071,25 +1125,3 @@ void GDriveProvider::handleRequests(std::shared_ptr<RequestData> reqData)
     }
 }
 
-void GDriveProvider::dispatchHandler()
-{
-    LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-    std::unique_lock < std::mutex > lock(mMutex, std::defer_lock);
-    lock.lock();
-    do {
-        mCondVar.wait(lock, [this] {
-            return (mQueue.size() || mQuit);
-        });
-        LOG_DEBUG_SAF("Dispatch notif received : %d, mQuit: %d", mQueue.size(), mQuit);
-        if (mQueue.size() && !mQuit)
-        {
-            auto request = mQueue.front();
-            mQueue.erase(mQueue.begin());
-            lock.unlock();
-            handleRequests(std::move(request));
-            lock.lock();
-        }
-    } while (!mQuit);
-}
-
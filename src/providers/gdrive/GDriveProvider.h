@@ -24,7 +24,7 @@
 #include <map>
 #include <thread>
 #include <mutex>
-#include <condition_variable>
+#include <shared_mutex>
 #include <SAFErrors.h>
 #include <sys/mount.h>
 
@@ -37,6 +37,8 @@ typedef struct GDriveUserData_
     std::shared_ptr<GDRIVE::Credential> mCred;
     std::string mClientId;
     std::string mClientSecret;
+    // Guards mAuthParam and replacing mCred; requests copy mCred under it
+    std::mutex mAuthMutex;
 } GDriveUserData;
 
 class GDriveProvider: public DocumentProvider
@@ -45,7 +47,6 @@ public:
     GDriveProvider();
     virtual ~GDriveProvider();
     void addRequest(std::shared_ptr<RequestData>&);
-    void dispatchHandler();
     void handleRequests(std::shared_ptr<RequestData>);
     void attachCloud(std::shared_ptr<RequestData> reqData);
     void authenticateCloud(std::shared_ptr<RequestData> reqData);
@@ -71,14 +72,12 @@ private:
     void setErrorMessage(std::shared_ptr<ValuePairMap>, std::string);
     bool validateExtraCommand(std::vector<std::string>, std::shared_ptr<RequestData>);
     map<std::string, std::string> mimetypesMap;
-    std::vector<std::shared_ptr<RequestData>> mQueue;
-    std::thread mDispatcherThread;
-    std::mutex mMutex;
-    std::condition_variable mCondVar;
-    volatile bool mQuit = false;
+    std::shared_mutex mStateMutex;
 
 private:
     std::string generateDriveId();
+    GDriveUserData* findUserData(const std::string&, std::string&);
+    std::shared_ptr<GDRIVE::Credential> getCredential(GDriveUserData&);
     std::map<std::string, GDriveUserData> mDriveIdUserDataMap;
     std::map<std::string, std::string> mDriveIdSessionMap;
     std::map<std::string, std::string> mClientIdDriveId;
@@ -16,21 +16,20 @@
 #include "SAFLunaService.h"
 #include "InternalStorageProvider.h"
 #include "SAFUtilityOperation.h"
+#include "SAFWorkerPool.h"
+#include "DeviceQueues.h"
+#include "TransferManager.h"
 #include "UpnpDiscover.h"
 #include <libxml/tree.h>
 
 using namespace std;
 
-InternalStorageProvider::InternalStorageProvider() : mQuit(false)
+InternalStorageProvider::InternalStorageProvider()
 {
-    mDispatcherThread = std::thread(std::bind(&InternalStorageProvider::dispatchHandler, this));
-    mDispatcherThread.detach();
 }
 
 InternalStorageProvider::~InternalStorageProvider()
 {
-    mQuit = true;
-    mCondVar.notify_one();
 }
 
 void InternalStorageProvider::listFolderContents(std::shared_ptr<RequestData> reqData)
@@ -56,31 +55,21 @@ void InternalStorageProvider::listFolderContents(std::shared_ptr<RequestData> re
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    int offset = reqData->params["offset"].asNumber<int>();
-    int limit = reqData->params["limit"].asNumber<int>();
     bool status = false;
-    int totalCount = 0;
-    std::string fullPath;
     pbnjson::JValue contenResArr = pbnjson::Array();
-    std::unique_ptr<FolderContents> contsPtr = SAFUtilityOperation::getInstance().getListFolderContents(std::move(path));
-    fullPath = contsPtr->getPath();
-    totalCount = contsPtr->getTotalCount();
-    if (contsPtr->getStatus() >= 0)
+    FolderPage page = SAFUtilityOperation::getInstance().getFolderPage(reqData, std::move(path));
+    if (page.mStatus >= 0)
     {
-        auto contVec = contsPtr->getContents();
-        int start = (offset > (int)contVec.size())?(contVec.size() + 1):(offset - 1);
-        start = (start < 0)?(contVec.size() + 1):(start);
-        int end = ((limit + offset - 1) >  contVec.size())?(contVec.size()):(limit + offset - 1);
-        end = (end < 0)?(contVec.size()):(end);
-        LOG_DEBUG_SAF("%s: start:%d, end: %d", __FUNCTION__,start,end);
-        for (int index = start; index < end; ++index)
+        for (auto& content : page.mEntries)
         {
-            std::string size_str = std::to_string(contVec[index]->getSize());
             pbnjson::JValue contentObj = pbnjson::Object();
-            contentObj.put("name", contVec[index]->getName());
-            contentObj.put("path", contVec[index]->getPath());
-            contentObj.put("type", contVec[index]->getType());
-            contentObj.put("size", size_str);
+            contentObj.put("name", content.getName());
+            contentObj.put("path", content.getPath());
+            contentObj.put("type", content.getType());
+            if (content.hasSize())
+                contentObj.put("size", std::to_string(content.getSize()));
+            if (content.hasSize() && content.isDirectory())
+                contentObj.put("fileCount", (int64_t)content.getFileCount());
             contenResArr.append(contentObj);
         }
         status = true;
@@ -89,12 +78,14 @@ void InternalStorageProvider::listFolderContents(std::shared_ptr<RequestData> re
     if (status)
     {
         respObj.put("files", contenResArr);
-        respObj.put("totalCount", totalCount);
-        respObj.put("fullPath", fullPath);
+        respObj.put("totalCount", (int)page.mTotalCount);
+        respObj.put("fullPath", page.mFullPath);
+        if (!page.mCursor.empty())
+            respObj.put("cursor", page.mCursor);
     }
     else
     {
-        auto errorCode = getInternalErrorCode(contsPtr->getStatus());
+        auto errorCode = getInternalErrorCode(page.mStatus);
         auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
         respObj.put("errorCode", errorCode);
         respObj.put("errorText", errorStr);
@@ -143,10 +134,18 @@ void InternalStorageProvider::getProperties(std::shared_ptr<RequestData> reqData
         attrObj.put("LastModTimeStamp", propPtr->getLastModTime());
         attributesArr.append(attrObj);
         respObj.put("attributes", attributesArr);
+        if (propPtr->hasTotals())
+        {
+            respObj.put("totalBytes", (int64_t)propPtr->getTotalBytes());
+            respObj.put("fileCount", (int64_t)propPtr->getFileCount());
+        }
         if (path == SAFUtilityOperation::getInstance().getInternalPath(reqData->sessionId))
         {
             respObj.put("totalSpace", int(propPtr->getCapacityMB()));
             respObj.put("freeSpace", int(propPtr->getFreeSpaceMB()));
+            respObj.put("totalSpaceBytes", (int64_t)propPtr->getCapacityBytes());
+            respObj.put("freeSpaceBytes", (int64_t)propPtr->getFreeSpaceBytes());
+            respObj.put("availableSpaceBytes", (int64_t)propPtr->getAvailSpaceBytes());
         }
     }
     else
@@ -182,35 +181,25 @@ void InternalStorageProvider::copy(std::shared_ptr<RequestData> reqData)
     if (reqData->params.hasKey("overwrite"))
         overwrite = reqData->params["overwrite"].asBool();
 
-    std::unique_ptr<InternalCopy> copyPtr = SAFUtilityOperation::getInstance().copy(std::move(srcPath), std::move(destPath), overwrite);
+    std::shared_ptr<TransferJob> job = TransferManager::getInstance().getJob(reqData->params["jobId"].asString());
+    std::unique_ptr<InternalCopy> copyPtr = SAFUtilityOperation::getInstance().copy(std::move(srcPath), std::move(destPath), overwrite, job);
 
-    int retStatus = -1;
-    int prevStatus = -20;
-    while(1)
+    // Progress is pushed by the job while the transfer runs; this is the final reply
+    int retStatus = copyPtr->getStatus();
+    bool status = (retStatus < 0)?(false):(true);
+    respObj.put("returnValue", status);
+    if (status)
     {
-        retStatus = copyPtr->getStatus();
-        LOG_DEBUG_SAF("%s: statussss : %d", __FUNCTION__, retStatus);
-        bool status = (retStatus < 0)?(false):(true);
-        respObj.put("returnValue", status);
-        if (status)
-        {
-            respObj.put("progress", retStatus);
-        }
-        else
-        {
-            auto errorCode = getInternalErrorCode(copyPtr->getStatus());
-            auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
-            respObj.put("errorCode", errorCode);
-            respObj.put("errorText", errorStr);
-        }
-        if (retStatus != prevStatus)
-            reqData->cb(respObj, reqData->subs);
-        if ((retStatus >= 100) || (retStatus < 0))
-            break;
-        else
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        prevStatus = retStatus;
+        respObj.put("progress", retStatus);
+    }
+    else
+    {
+        auto errorCode = getInternalErrorCode(retStatus);
+        auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
+        respObj.put("errorCode", errorCode);
+        respObj.put("errorText", errorStr);
     }
+    reqData->cb(std::move(respObj), reqData->subs);
 }
 
 void InternalStorageProvider::move(std::shared_ptr<RequestData> reqData)
@@ -236,35 +225,25 @@ void InternalStorageProvider::move(std::shared_ptr<RequestData> reqData)
     if (reqData->params.hasKey("overwrite"))
         overwrite = reqData->params["overwrite"].asBool();
 
-    std::unique_ptr<InternalMove> movePtr = SAFUtilityOperation::getInstance().move(std::move(srcPath), std::move(destPath), overwrite);
+    std::shared_ptr<TransferJob> job = TransferManager::getInstance().getJob(reqData->params["jobId"].asString());
+    std::unique_ptr<InternalMove> movePtr = SAFUtilityOperation::getInstance().move(std::move(srcPath), std::move(destPath), overwrite, job);
 
-    int retStatus = -1;
-    int prevStatus = -20;
-    while(1)
+    // Progress is pushed by the job while the transfer runs; this is the final reply
+    int retStatus = movePtr->getStatus();
+    bool status = (retStatus < 0)?(false):(true);
+    respObj.put("returnValue", status);
+    if (status)
     {
-        retStatus = movePtr->getStatus();
-        LOG_DEBUG_SAF("%s: statussss : %d", __FUNCTION__, retStatus);
-        bool status = (retStatus < 0)?(false):(true);
-        respObj.put("returnValue", status);
-        if (status)
-        {
-            respObj.put("progress", retStatus);
-        }
-        else
-        {
-            auto errorCode = getInternalErrorCode(movePtr->getStatus());
-            auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
-            respObj.put("errorCode", errorCode);
-            respObj.put("errorText", errorStr);
-        }
-        if (retStatus != prevStatus)
-            reqData->cb(respObj, reqData->subs);
-        if ((retStatus >= 100) || (retStatus < 0))
-            break;
-        else
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        prevStatus = retStatus;
+        respObj.put("progress", retStatus);
+    }
+    else
+    {
+        auto errorCode = getInternalErrorCode(retStatus);
+        auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
+        respObj.put("errorCode", errorCode);
+        respObj.put("errorText", errorStr);
     }
+    reqData->cb(std::move(respObj), reqData->subs);
 }
 
 void InternalStorageProvider::remove(std::shared_ptr<RequestData> reqData)
@@ -291,12 +270,88 @@ void InternalStorageProvider::remove(std::shared_ptr<RequestData> reqData)
         return;
     }
 
-    std::unique_ptr<InternalRemove> remPtr = SAFUtilityOperation::getInstance().remove(std::move(path));
-    bool status = (remPtr->getStatus() < 0)?(false):(true);
+    int32_t retStatus;
+    std::string trashId;
+    if (reqData->params.hasKey("trash") && reqData->params["trash"].asBool())
+    {
+        retStatus = SAFUtilityOperation::getInstance().moveToTrash(std::move(path),
+            SAFUtilityOperation::getInstance().getInternalPath(sessionId), trashId);
+    }
+    else
+    {
+        std::string purgeRoot;
+        if (reqData->params.hasKey("detach") && reqData->params["detach"].asBool())
+            purgeRoot = SAFUtilityOperation::getInstance().getInternalPath(sessionId);
+        std::shared_ptr<TransferJob> job = TransferManager::getInstance().getJob(reqData->params["jobId"].asString());
+        std::unique_ptr<InternalRemove> remPtr = SAFUtilityOperation::getInstance().remove(std::move(path), job, std::move(purgeRoot));
+        retStatus = remPtr->getStatus();
+    }
+    bool status = (retStatus < 0)?(false):(true);
+    respObj.put("returnValue", status);
+    if (status && !trashId.empty())
+    {
+        respObj.put("trashId", trashId);
+    }
+    else if (!status)
+    {
+        auto errorCode = getInternalErrorCode(retStatus);
+        auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
+        respObj.put("errorCode", errorCode);
+        respObj.put("errorText", errorStr);
+    }
+    reqData->cb(std::move(respObj), reqData->subs);
+}
+
+void InternalStorageProvider::restore(std::shared_ptr<RequestData> reqData)
+{
+    LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
+    pbnjson::JValue respObj = pbnjson::Object();
+    if(DEFAULT_INTERNAL_STORAGE_ID != reqData->params["driveId"].asString())
+    {
+        respObj.put("errorCode", SAFErrors::INVALID_PARAM);
+        respObj.put("errorText", "Invalid DriveID");
+        reqData->cb(respObj, reqData->subs);
+        return;
+    }
+    std::string trashId = reqData->params.hasKey("trashId") ? reqData->params["trashId"].asString() : "";
+    std::string path = reqData->params.hasKey("path") ? reqData->params["path"].asString() : "";
+    std::string restoredPath;
+    int32_t retStatus = SAFUtilityOperation::getInstance().restoreFromTrash(
+        SAFUtilityOperation::getInstance().getInternalPath(reqData->sessionId), std::move(trashId), std::move(path), restoredPath);
+    bool status = (retStatus < 0)?(false):(true);
+    respObj.put("returnValue", status);
+    if (status)
+    {
+        respObj.put("path", restoredPath);
+    }
+    else
+    {
+        auto errorCode = getInternalErrorCode(retStatus);
+        auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
+        respObj.put("errorCode", errorCode);
+        respObj.put("errorText", errorStr);
+    }
+    reqData->cb(std::move(respObj), reqData->subs);
+}
+
+void InternalStorageProvider::emptyTrash(std::shared_ptr<RequestData> reqData)
+{
+    LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
+    pbnjson::JValue respObj = pbnjson::Object();
+    if(DEFAULT_INTERNAL_STORAGE_ID != reqData->params["driveId"].asString())
+    {
+        respObj.put("errorCode", SAFErrors::INVALID_PARAM);
+        respObj.put("errorText", "Invalid DriveID");
+        reqData->cb(respObj, reqData->subs);
+        return;
+    }
+    int32_t retStatus = SAFUtilityOperation::getInstance().emptyTrash(
+        SAFUtilityOperation::getInstance().getInternalPath(reqData->sessionId));
+    bool status = (retStatus < 0)?(false):(true);
     respObj.put("returnValue", status);
     if (!status)
     {
-        auto errorCode = getInternalErrorCode(remPtr->getStatus());
+        auto errorCode = getInternalErrorCode(retStatus);
         auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
         respObj.put("errorCode", errorCode);
         respObj.put("errorText", errorStr);
@@ -371,11 +426,10 @@ void InternalStorageProvider::listStoragesMethod(std::shared_ptr<RequestData> re
 
 void InternalStorageProvider::addRequest(std::shared_ptr<RequestData>& reqData)
 {
-    {
-        std::unique_lock < std::mutex > lock(mMutex);
-        mQueue.push_back(std::move(reqData));
-    }
-    mCondVar.notify_one();
+    std::shared_ptr<RequestData> request = std::move(reqData);
+    // A transfer onto a stick shares the stick's queue with the USB provider
+    DeviceQueues::getInstance().submit(DeviceQueues::getUSBDevices(request), SAFWorkerPool::getLane(request),
+        [this, request]() { handleRequests(request); });
 }
 
 bool InternalStorageProvider::onReply(LSHandle *sh, LSMessage *message , void *ctx)
@@ -426,57 +480,61 @@ void InternalStorageProvider::handleRequests(std::shared_ptr<RequestData> reqDat
         case MethodType::LIST_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::LIST_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->listFolderContents(reqData); });
-            (void)fut;
+            listFolderContents(reqData);
         }
         break;
         case MethodType::GET_PROP_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::GET_PROP_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->getProperties(reqData); });
-            (void)fut;
+            getProperties(reqData);
         }
         break;
         case MethodType::COPY_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::COPY_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->copy(reqData); });
-            (void)fut;
+            copy(reqData);
         }
         break;
         case MethodType::MOVE_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::MOVE_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->move(reqData); });
-            (void)fut;
+            move(reqData);
         }
         break;
         case MethodType::REMOVE_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::REMOVE_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->remove(reqData); });
-            (void)fut;
+            remove(reqData);
         }
         break;
         case MethodType::EJECT_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::EJECT_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->eject(reqData); });
-            (void)fut;
+            eject(reqData);
         }
         break;
         case MethodType::RENAME_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::RENAME_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->rename(reqData); });
-            (void)fut;
+            rename(reqData);
         }
         break;
         case MethodType::LIST_STORAGES_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::LIST_STORAGES_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->listStoragesMethod(reqData); });
-            (void)fut;
+            listStoragesMethod(reqData);
+        }
+        break;
+        case MethodType::RESTORE_METHOD:
+        {
+            LOG_DEBUG_SAF("%s : MethodType::RESTORE_METHOD", __FUNCTION__);
+            restore(reqData);
+        }
+        break;
+        case MethodType::EMPTY_TRASH_METHOD:
+        {
+            LOG_DEBUG_SAF("%s : MethodType::EMPTY_TRASH_METHOD", __FUNCTION__);
+            emptyTrash(reqData);
         }
         break;
         default:
@@ -485,25 +543,3 @@ void InternalStorageProvider::handleRequests(std::shared_ptr<RequestData> reqDat
     }
 }
 
-void InternalStorageProvider::dispatchHandler()
-{
-    LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-    std::unique_lock < std::mutex > lock(mMutex, std::defer_lock);
-    lock.lock();
-    do {
-        mCondVar.wait(lock, [this] {
-            return (mQueue.size() || mQuit);
-        });
-        LOG_DEBUG_SAF("Dispatch notif received : %d, mQuit: %d", mQueue.size(), mQuit);
-        if (mQueue.size() && !mQuit)
-        {
-            auto request = mQueue.front();
-            mQueue.erase(mQueue.begin());
-            lock.unlock();
-            handleRequests(std::move(request));
-            lock.lock();
-        }
-    } while (!mQuit);
-}
-
@@ -18,9 +18,6 @@
 #include <iostream>
 #include <vector>
 #include <map>
-#include <thread>
-#include <mutex>
-#include <condition_variable>
 #include <luna-service2/lunaservice.hpp>
 #include <pbnjson.hpp>
 
@@ -32,7 +29,6 @@ public:
     InternalStorageProvider();
     virtual ~InternalStorageProvider();
 	void addRequest(std::shared_ptr<RequestData>&);
-	void dispatchHandler();
     void handleRequests(std::shared_ptr<RequestData>);
 	void listStoragesMethod(std::shared_ptr<RequestData> reqData);
     void listFolderContents(std::shared_ptr<RequestData> reqData);
@@ -40,17 +36,11 @@ public:
     void copy(std::shared_ptr<RequestData> reqData);
     void move(std::shared_ptr<RequestData> reqData);
     void remove(std::shared_ptr<RequestData> reqData);
+    void restore(std::shared_ptr<RequestData> reqData);
+    void emptyTrash(std::shared_ptr<RequestData> reqData);
 	void rename(std::shared_ptr<RequestData> reqData);
     void eject(std::shared_ptr<RequestData> reqData);
     static bool onReply(LSHandle*, LSMessage*, void*);
-
-private:
-    std::vector<std::shared_ptr<RequestData>> mQueue;
-    std::thread mDispatcherThread;
-    std::mutex mMutex;
-    std::condition_variable mCondVar;
-    volatile bool mQuit;
-
 };
 
 #endif /* _INTERNAL_STORAGE_PROVIDER_H_ */
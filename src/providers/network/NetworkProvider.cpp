@@ -19,21 +19,20 @@
 #include <iomanip>
 #include "gdrive/gdrive.hpp"
 #include "SAFUtilityOperation.h"
+#include "SAFWorkerPool.h"
+#include "DeviceQueues.h"
+#include "TransferManager.h"
 #include "UpnpDiscover.h"
 #include "UpnpOperation.h"
 
 
-NetworkProvider::NetworkProvider() : mQuit(false)
+NetworkProvider::NetworkProvider()
 {
     LOG_DEBUG_SAF(" NetworkProvider:: Constructor Created");
-    mDispatcherThread = std::thread(std::bind(&NetworkProvider::dispatchHandler, this));
-    mDispatcherThread.detach();
 }
 
 NetworkProvider::~NetworkProvider()
 {
-    mQuit = true;
-    mCondVar.notify_one();
 }
 
 void NetworkProvider::setErrorMessage(shared_ptr<ValuePairMap> valueMap, string errorText)
@@ -90,19 +89,33 @@ void NetworkProvider::extraMethod(std::shared_ptr<RequestData> reqData)
 bool NetworkProvider::validateSambaOperation(std::string driveId,
     std::string sessionId)
 {
-    if ((mSambaSessionData.find(driveId) != mSambaSessionData.end())
-        && (mSambaSessionData[driveId] == sessionId))
-        return true;
-    return false;
+    std::shared_lock<std::shared_mutex> lock(mStateMutex);
+    auto itr = mSambaSessionData.find(driveId);
+    return ((itr != mSambaSessionData.end()) && (itr->second == sessionId));
 }
 
 bool NetworkProvider::validateUpnpOperation(std::string driveId,
     std::string sessionId)
 {
-    if ((mUpnpSessionData.find(driveId) != mUpnpSessionData.end())
-        && (mUpnpSessionData[driveId] == sessionId))
-        return true;
-    return false;
+    std::shared_lock<std::shared_mutex> lock(mStateMutex);
+    auto itr = mUpnpSessionData.find(driveId);
+    return ((itr != mUpnpSessionData.end()) && (itr->second == sessionId));
+}
+
+bool NetworkProvider::isDriveKnown(const std::string& type, const std::string& driveId)
+{
+    std::shared_lock<std::shared_mutex> lock(mStateMutex);
+    if (type == UPNP_NAME)
+        return (mUpnpSessionData.find(driveId) != mUpnpSessionData.end());
+    return (mSambaSessionData.find(driveId) != mSambaSessionData.end());
+}
+
+std::string NetworkProvider::getDrivePath(const std::string& type, const std::string& driveId)
+{
+    std::shared_lock<std::shared_mutex> lock(mStateMutex);
+    auto& pathMap = (type == UPNP_NAME) ? mUpnpPathMap : mSambaPathMap;
+    auto itr = pathMap.find(driveId);
+    return (itr == pathMap.end()) ? "" : itr->second;
 }
 
 std::string NetworkProvider::generateUniqueSambaDriveId()
@@ -162,43 +175,63 @@ void NetworkProvider::mountSambaServer(std::shared_ptr<RequestData> reqData)
 
         std::string path = "/tmp/" + ip + "_" +  getTimestamp();
         std::string uniqueKey = ip + "_" + userName + "_" + sharePath;
-        if (mSambaDriveMap.find(uniqueKey) != mSambaDriveMap.end())
+        bool mounted = false;
+        bool pathInUse = false;
+        {
+            std::shared_lock<std::shared_mutex> lock(mStateMutex);
+            mounted = (mSambaDriveMap.find(uniqueKey) != mSambaDriveMap.end());
+            pathInUse = (mntpathmap.find(path) != mntpathmap.end());
+        }
+        if (mounted)
         {
             respObj.put("returnValue", false);
             respObj.put("error", "Already Mounted ");
             reqData->cb(respObj, reqData->subs);
             return;
         }
-        FILE *fp;
-        std::string pathCreate = "mkdir -p " + path;
-        fp = popen(pathCreate.c_str(),"r");
-        if(fp == NULL)
+        if(!SAFUtilityOperation::getInstance().createDirectories(path))
         {
-            LOG_DEBUG_SAF("mountSambaServer::File Open Failed");
+            LOG_DEBUG_SAF("mountSambaServer::Mount path creation Failed");
             respObj.put("returnValue", false);
             respObj.put("errorText", "Cannot create mount path  directory");
             reqData->cb(respObj, reqData->subs);
             return;
         }
-        else
-          pclose(fp);
        std::string src  = "//" + ip + "/" + userName;
        const unsigned long mntflags = 0;
        const char* type = "cifs";
-       if(mntpathmap.find(path) == mntpathmap.end()){
+       if(!pathInUse){
        std::string data = "ip=" + ip + ",unc=\\\\" + ip + "\\" + userName + ",user=" + userName + ",pass=" + password + ",sec=" + securityMode
                       + ",uid=" +std::to_string(uid) + ",gid="+std::to_string(gid);
+       // The mount can block on the server, so no lock is held across it
        int result = mount (src.c_str(), path.c_str(), type, mntflags , data.c_str());
        LOG_DEBUG_SAF("Entering function data :%s", data.c_str());
 
        if (result == 0)
        {
           SAFUtilityOperation::getInstance().setPathPerm(path, reqData->sessionId);
-          mSambaDriveMap[uniqueKey] = generateUniqueSambaDriveId();
-          mSambaSessionData[mSambaDriveMap[uniqueKey]] = reqData->sessionId;
-          mSambaPathMap[mSambaDriveMap[uniqueKey]] = path;
-          SAFUtilityOperation::getInstance().setDriveDetails(SAMBA_NAME, mSambaPathMap);
-          mntpathmap[path] = path;
+          {
+              std::unique_lock<std::shared_mutex> lock(mStateMutex);
+              mounted = (mSambaDriveMap.find(uniqueKey) != mSambaDriveMap.end());
+              if (!mounted)
+              {
+                  mSambaDriveMap[uniqueKey] = generateUniqueSambaDriveId();
+                  mSambaSessionData[mSambaDriveMap[uniqueKey]] = reqData->sessionId;
+                  mSambaPathMap[mSambaDriveMap[uniqueKey]] = path;
+                  SAFUtilityOperation::getInstance().setDriveDetails(SAMBA_NAME, mSambaPathMap);
+                  mntpathmap[path] = path;
+              }
+          }
+          if (mounted)
+          {
+              // Another request mounted the same share meanwhile
+              umount2(path.c_str(), MNT_FORCE);
+              rmdir(path.c_str());
+              respObj.put("returnValue", false);
+              respObj.put("error", "Already Mounted ");
+              reqData->cb(respObj, reqData->subs);
+              return;
+          }
           pbnjson::JValue responsePayObjArr = pbnjson::Array();
           pbnjson::JValue responsePayObj = pbnjson::Object();
           pbnjson::JValue mountObj = pbnjson::Object();
@@ -269,6 +302,7 @@ void NetworkProvider::discoverUPnPMediaServer(std::shared_ptr<RequestData> reqDa
         mediaObj = parseMediaServer(dev);
         std::string uniqueKey = mediaObj["ip"].asString() + "_" + mediaObj["port"].asString();
         LOG_DEBUG_SAF("UPnP uniqueKey : %s", uniqueKey.c_str());
+        std::unique_lock<std::shared_mutex> lock(mStateMutex);
         if (mUpnpDriveMap.find(uniqueKey) == mUpnpDriveMap.end())
         {
             mUpnpDriveMap[uniqueKey] = generateUniqueUpnpDriveId();
@@ -298,8 +332,7 @@ void NetworkProvider::list(std::shared_ptr<RequestData> reqData)
     std::string path = reqData->params["path"].asString();
     std::string type = SAMBA_NAME;
     if (driveId.find(UPNP_NAME) != std::string::npos)   type = UPNP_NAME;
-    if (((type == SAMBA_NAME) && (mSambaSessionData.find(driveId) == mSambaSessionData.end()))
-    || ((type == UPNP_NAME) && (mUpnpSessionData.find(driveId) == mUpnpSessionData.end())))
+    if (!isDriveKnown(type, driveId))
     {
         respObj.put("errorCode", SAFErrors::INVALID_PARAM);
         respObj.put("errorText", "Invalid DriveID");
@@ -322,30 +355,21 @@ void NetworkProvider::list(std::shared_ptr<RequestData> reqData)
             reqData->cb(respObj, reqData->subs);
             return;
         }
-        int offset = reqData->params["offset"].asNumber<int>();
-        int limit = reqData->params["limit"].asNumber<int>();
         bool status = false;
-        int totalCount = 0;
-        std::string fullPath;
         pbnjson::JValue contenResArr = pbnjson::Array();
-        std::unique_ptr<FolderContents> contsPtr = SAFUtilityOperation::getInstance().getListFolderContents(std::move(path));
-        fullPath = contsPtr->getPath();
-        totalCount = contsPtr->getTotalCount();
-        if (contsPtr->getStatus() >= 0)
-        {
-            auto contVec = contsPtr->getContents();
-            int start = (offset > (int)contVec.size())?(contVec.size() + 1):(offset - 1);
-            start = (start < 0)?(contVec.size() + 1):(start);
-            int end = ((limit + offset - 1) >  contVec.size())?(contVec.size()):(limit + offset - 1);
-            end = (end < 0)?(contVec.size()):(end);
-            LOG_DEBUG_SAF("%s: start:%d, end: %d", __FUNCTION__,start,end);
-            for (int index = start; index < end; ++index)
+        FolderPage page = SAFUtilityOperation::getInstance().getFolderPage(reqData, std::move(path));
+        if (page.mStatus >= 0)
+        {
+            for (auto& content : page.mEntries)
             {
                 pbnjson::JValue contentObj = pbnjson::Object();
-                contentObj.put("name", contVec[index]->getName());
-                contentObj.put("path", contVec[index]->getPath());
-                contentObj.put("type", contVec[index]->getType());
-                contentObj.put("size", int(contVec[index]->getSize()));
+                contentObj.put("name", content.getName());
+                contentObj.put("path", content.getPath());
+                contentObj.put("type", content.getType());
+                if (content.hasSize())
+                    contentObj.put("size", int(content.getSize()));
+                if (content.hasSize() && content.isDirectory())
+                    contentObj.put("fileCount", (int64_t)content.getFileCount());
                 contenResArr.append(contentObj);
             }
             status = true;
@@ -354,12 +378,14 @@ void NetworkProvider::list(std::shared_ptr<RequestData> reqData)
         if (status)
         {
             respObj.put("files", contenResArr);
-            respObj.put("totalCount", totalCount);
-            respObj.put("fullPath", fullPath);
+            respObj.put("totalCount", (int)page.mTotalCount);
+            respObj.put("fullPath", page.mFullPath);
+            if (!page.mCursor.empty())
+                respObj.put("cursor", page.mCursor);
         }
         else
         {
-            auto errorCode = getInternalErrorCode(contsPtr->getStatus());
+            auto errorCode = getInternalErrorCode(page.mStatus);
             auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
             respObj.put("errorCode", errorCode);
             respObj.put("errorText", errorStr);
@@ -389,8 +415,9 @@ void NetworkProvider::list(std::shared_ptr<RequestData> reqData)
         pbnjson::JValue respObj = pbnjson::Object();
         bool status = false;
         int totalCount = 0;
-        LOG_DEBUG_SAF("UPnP Description URL  : %s", mUpnpPathMap[driveId].c_str());
-        auto containerId = UpnpOperation::getInstance().getContainerId(mUpnpPathMap[driveId], path);
+        std::string descriptionUrl = getDrivePath(UPNP_NAME, driveId);
+        LOG_DEBUG_SAF("UPnP Description URL  : %s", descriptionUrl.c_str());
+        auto containerId = UpnpOperation::getInstance().getContainerId(descriptionUrl, path);
         LOG_DEBUG_SAF("UPnP container Id : %d", containerId);
         auto devs = UpnpOperation::getInstance().listDirContents(containerId);
         LOG_DEBUG_SAF("UPnP devs size : %d", devs.size());
@@ -430,8 +457,7 @@ void NetworkProvider::getProperties(std::shared_ptr<RequestData> reqData)
     std::string driveId = reqData->params["driveId"].asString();
     std::string type = SAMBA_NAME;
     if (driveId.find(UPNP_NAME) != std::string::npos)   type = UPNP_NAME;
-    if (((type == SAMBA_NAME) && (mSambaSessionData.find(driveId) == mSambaSessionData.end()))
-    || ((type == UPNP_NAME) && (mUpnpSessionData.find(driveId) == mUpnpSessionData.end())))
+    if (!isDriveKnown(type, driveId))
     {
         respObj.put("errorCode", SAFErrors::INVALID_PARAM);
         respObj.put("errorText", "Invalid DriveID");
@@ -449,7 +475,7 @@ void NetworkProvider::getProperties(std::shared_ptr<RequestData> reqData)
             reqData->cb(respObj, reqData->subs);
             return;
         }
-        path = mUpnpPathMap[driveId];
+        path = getDrivePath(UPNP_NAME, driveId);
     }
     else
     {
@@ -460,7 +486,7 @@ void NetworkProvider::getProperties(std::shared_ptr<RequestData> reqData)
             reqData->cb(respObj, reqData->subs);
             return;
         }
-        path = mSambaPathMap[driveId];
+        path = getDrivePath(SAMBA_NAME, driveId);
     }
     if (reqData->params.hasKey("path"))
     {
@@ -472,7 +498,7 @@ void NetworkProvider::getProperties(std::shared_ptr<RequestData> reqData)
     pbnjson::JValue attributesArr = pbnjson::Array();
     if (type == UPNP_NAME)
     {
-        auto containerId = UpnpOperation::getInstance().getContainerId(mUpnpPathMap[driveId], std::move(path));
+        auto containerId = UpnpOperation::getInstance().getContainerId(getDrivePath(UPNP_NAME, driveId), std::move(path));
         LOG_DEBUG_SAF("UPnP container Id : %d", containerId);
         auto devs = UpnpOperation::getInstance().listDirContents(containerId);
         LOG_DEBUG_SAF("UPnP devs size : %d", devs.size());
@@ -512,10 +538,13 @@ void NetworkProvider::getProperties(std::shared_ptr<RequestData> reqData)
             attrObj.put("LastModTimeStamp", propPtr->getLastModTime());
             attributesArr.append(attrObj);
             respObj.put("attributes", attributesArr);
-            if (path == mSambaPathMap[driveId])
+            if (path == getDrivePath(SAMBA_NAME, driveId))
             {
                 respObj.put("totalSpace", int(propPtr->getCapacityMB()));
                 respObj.put("freeSpace", int(propPtr->getFreeSpaceMB()));
+                respObj.put("totalSpaceBytes", (int64_t)propPtr->getCapacityBytes());
+                respObj.put("freeSpaceBytes", (int64_t)propPtr->getFreeSpaceBytes());
+                respObj.put("availableSpaceBytes", (int64_t)propPtr->getAvailSpaceBytes());
             }
         }
         else
@@ -555,35 +584,25 @@ void NetworkProvider::copy(std::shared_ptr<RequestData> reqData)
     if (reqData->params.hasKey("overwrite"))
         overwrite = reqData->params["overwrite"].asBool();
 
-    std::unique_ptr<InternalCopy> copyPtr = SAFUtilityOperation::getInstance().copy(std::move(srcPath), std::move(destPath), overwrite);
+    std::shared_ptr<TransferJob> job = TransferManager::getInstance().getJob(reqData->params["jobId"].asString());
+    std::unique_ptr<InternalCopy> copyPtr = SAFUtilityOperation::getInstance().copy(std::move(srcPath), std::move(destPath), overwrite, job);
 
-    int retStatus = -1;
-    int prevStatus = -20;
-    while(1)
+    // Progress is pushed by the job while the transfer runs; this is the final reply
+    int retStatus = copyPtr->getStatus();
+    bool status = (retStatus < 0)?(false):(true);
+    respObj.put("returnValue", status);
+    if (status)
     {
-        retStatus = copyPtr->getStatus();
-        LOG_DEBUG_SAF("%s: statussss : %d", __FUNCTION__, retStatus);
-        bool status = (retStatus < 0)?(false):(true);
-        respObj.put("returnValue", status);
-        if (status)
-        {
-            respObj.put("progress", retStatus);
-        }
-        else
-        {
-            auto errorCode = getInternalErrorCode(copyPtr->getStatus());
-            auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
-            respObj.put("errorCode", errorCode);
-            respObj.put("errorText", errorStr);
-        }
-        if (retStatus != prevStatus)
-            reqData->cb(respObj, reqData->subs);
-        if ((retStatus >= 100) || (retStatus < 0))
-            break;
-        else
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        prevStatus = retStatus;
+        respObj.put("progress", retStatus);
     }
+    else
+    {
+        auto errorCode = getInternalErrorCode(retStatus);
+        auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
+        respObj.put("errorCode", errorCode);
+        respObj.put("errorText", errorStr);
+    }
+    reqData->cb(std::move(respObj), reqData->subs);
 
 }
 
@@ -611,35 +630,25 @@ void NetworkProvider::move(std::shared_ptr<RequestData> reqData)
     if (reqData->params.hasKey("overwrite"))
         overwrite = reqData->params["overwrite"].asBool();
 
-    std::unique_ptr<InternalMove> movePtr = SAFUtilityOperation::getInstance().move(std::move(srcPath), std::move(destPath), overwrite);
+    std::shared_ptr<TransferJob> job = TransferManager::getInstance().getJob(reqData->params["jobId"].asString());
+    std::unique_ptr<InternalMove> movePtr = SAFUtilityOperation::getInstance().move(std::move(srcPath), std::move(destPath), overwrite, job);
 
-    int retStatus = -1;
-    int prevStatus = -20;
-    while(1)
+    // Progress is pushed by the job while the transfer runs; this is the final reply
+    int retStatus = movePtr->getStatus();
+    bool status = (retStatus < 0)?(false):(true);
+    respObj.put("returnValue", status);
+    if (status)
     {
-        retStatus = movePtr->getStatus();
-        LOG_DEBUG_SAF("%s: statussss : %d", __FUNCTION__, retStatus);
-        bool status = (retStatus < 0)?(false):(true);
-        respObj.put("returnValue", status);
-        if (status)
-        {
-            respObj.put("progress", retStatus);
-        }
-        else
-        {
-            auto errorCode = getInternalErrorCode(movePtr->getStatus());
-            auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
-            respObj.put("errorCode", errorCode);
-            respObj.put("errorText", errorStr);
-        }
-        if (retStatus != prevStatus)
-            reqData->cb(respObj, reqData->subs);
-        if ((retStatus >= 100) || (retStatus < 0))
-            break;
-        else
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        prevStatus = retStatus;
+        respObj.put("progress", retStatus);
     }
+    else
+    {
+        auto errorCode = getInternalErrorCode(retStatus);
+        auto errorStr = SAFErrors::InternalErrors::getInternalErrorString(errorCode);
+        respObj.put("errorCode", errorCode);
+        respObj.put("errorText", errorStr);
+    }
+    reqData->cb(std::move(respObj), reqData->subs);
 }
 
 void NetworkProvider::remove(std::shared_ptr<RequestData> reqData)
@@ -662,7 +671,9 @@ void NetworkProvider::remove(std::shared_ptr<RequestData> reqData)
         reqData->cb(respObj, reqData->subs);
         return;
     }
-    std::unique_ptr<InternalRemove> remPtr = SAFUtilityOperation::getInstance().remove(std::move(path));
+    // Never detached: a purge over the network is no cheaper later than now
+    std::shared_ptr<TransferJob> job = TransferManager::getInstance().getJob(reqData->params["jobId"].asString());
+    std::unique_ptr<InternalRemove> remPtr = SAFUtilityOperation::getInstance().remove(std::move(path), job);
     bool status = (remPtr->getStatus() < 0)?(false):(true);
     respObj.put("returnValue", status);
     if (!status)
@@ -716,13 +727,14 @@ void NetworkProvider::listStoragesMethod(std::shared_ptr<RequestData> reqData)
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
     pbnjson::JValue respObj = pbnjson::Object();
     pbnjson::JValue networkResArr = pbnjson::Array();
+    std::shared_lock<std::shared_mutex> lock(mStateMutex);
     for (auto & data : mSambaSessionData)
     {
         if (data.second != reqData->sessionId)  continue;
         pbnjson::JValue networkRes = pbnjson::Object();
         networkRes.put("driveName", "SAMBA");
         networkRes.put("driveId", data.first);
-        networkRes.put("path", mSambaPathMap[data.first]);
+        networkRes.put("path", mSambaPathMap.at(data.first));
         networkResArr.append(networkRes);
     }
     for (auto & data : mUpnpSessionData)
@@ -731,9 +743,10 @@ void NetworkProvider::listStoragesMethod(std::shared_ptr<RequestData> reqData)
         pbnjson::JValue networkRes = pbnjson::Object();
         networkRes.put("driveName", "UPNP");
         networkRes.put("driveId", data.first);
-        networkRes.put("path", mUpnpPathMap[data.first]);
+        networkRes.put("path", mUpnpPathMap.at(data.first));
         networkResArr.append(networkRes);
     }
+    lock.unlock();
     respObj.put("network", networkResArr);
     reqData->params.put("response", respObj);
     reqData->cb(reqData->params, std::move(reqData->subs));
@@ -752,23 +765,34 @@ void NetworkProvider::eject(std::shared_ptr<RequestData> reqData)
         reqData->cb(reqData->params, std::move(reqData->subs));
         return;
     }
-    for(auto & entry : mSambaDriveMap)
+    std::string mountPath;
     {
-        if(entry.second == driveId)
+        std::unique_lock<std::shared_mutex> lock(mStateMutex);
+        for(auto & entry : mSambaDriveMap)
         {
-            mSambaDriveMap.erase(entry.first);
-            break;
+            if(entry.second == driveId)
+            {
+                mSambaDriveMap.erase(entry.first);
+                break;
+            }
         }
+        auto itr = mSambaPathMap.find(driveId);
+        if (itr != mSambaPathMap.end())
+            mountPath = itr->second;
     }
     respObj.put("returnValue", true);
-    if(mSambaPathMap.find(driveId) != mSambaPathMap.end()){
-     int result =  umount2(mSambaPathMap[driveId].c_str(),MNT_FORCE);
+    if(!mountPath.empty()){
+     // Unmounting may wait on the server; the maps are only locked to update them
+     int result =  umount2(mountPath.c_str(),MNT_FORCE);
      if (result ==0){
-         SAFUtilityOperation::getInstance().remove(mSambaPathMap[driveId]);
-         mntpathmap.erase(mSambaPathMap[driveId]);
-         mSambaSessionData.erase(driveId);
-         mSambaPathMap.erase(driveId);
-         SAFUtilityOperation::getInstance().setDriveDetails(SAMBA_NAME, mSambaPathMap);
+         SAFUtilityOperation::getInstance().remove(mountPath);
+         {
+             std::unique_lock<std::shared_mutex> lock(mStateMutex);
+             mntpathmap.erase(mountPath);
+             mSambaSessionData.erase(driveId);
+             mSambaPathMap.erase(driveId);
+             SAFUtilityOperation::getInstance().setDriveDetails(SAMBA_NAME, mSambaPathMap);
+         }
          respObj.put("returnValue", true);
          respObj.put("unmountPath: ", driveId);
      }
@@ -788,79 +812,72 @@ void NetworkProvider::eject(std::shared_ptr<RequestData> reqData)
 void NetworkProvider::addRequest(std::shared_ptr<RequestData>& reqData)
 {
     LOG_DEBUG_SAF("NetworkProvider :: Entering function %s", __FUNCTION__);
-    {
-        std::unique_lock < std::mutex > lock(mMutex);
-        mQueue.push_back(std::move(reqData));
-    }
-    mCondVar.notify_one();
+    std::shared_ptr<RequestData> request = std::move(reqData);
+    // A transfer onto a stick shares the stick's queue with the USB provider
+    DeviceQueues::getInstance().submit(DeviceQueues::getUSBDevices(request), SAFWorkerPool::getLane(request),
+        [this, request]() { handleRequests(request); });
 }
 
 void NetworkProvider::handleRequests(std::shared_ptr<RequestData> reqData)
 {
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
+    // Requests run concurrently on the shared pool. mStateMutex is taken only
+    // around reads and updates of the drive maps, never across a mount,
+    // a discovery scan or file I/O, so no worker waits behind those.
     switch(reqData->methodType)
     {
         case MethodType::EXTRA_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::EXTRA_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->extraMethod(reqData); });
-            (void)fut;
+            extraMethod(reqData);
         }
         break;
         case MethodType::LIST_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::GET_PROP_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->list(reqData); });
-            (void)fut;
+            list(reqData);
         }
         break;
         case MethodType::GET_PROP_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::GET_PROP_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->getProperties(reqData); });
-            (void)fut;
+            getProperties(reqData);
         }
         break;
         case MethodType::REMOVE_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::REMOVE_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->remove(reqData); });
-            (void)fut;
+            remove(reqData);
         }
         break;
         case MethodType::MOVE_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::MOVE_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->move(reqData); });
-            (void)fut;
+            move(reqData);
         }
         break;
         case MethodType::COPY_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::COPY_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->copy(reqData); });
-            (void)fut;
+            copy(reqData);
         }
         break;
         case MethodType::RENAME_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::RENAME_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->rename(reqData); });
-            (void)fut;
+            rename(reqData);
         }
         break;
         case MethodType::LIST_STORAGES_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::LIST_STORAGES_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->listStoragesMethod(reqData); });
-            (void)fut;
+            listStoragesMethod(reqData);
         }
         break;
         case MethodType::EJECT_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::EJECT_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->eject(reqData); });
-            (void)fut;
+            eject(reqData);
         }
         break;
         default:
@@ -868,25 +885,3 @@ void NetworkProvider::handleRequests(std::shared_ptr<RequestData> reqData)
     }
 }
 
-void NetworkProvider::dispatchHandler()
-{
-    LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-    std::unique_lock < std::mutex > lock(mMutex, std::defer_lock);
-    lock.lock();
-    do {
-        mCondVar.wait(lock, [this] {
-            return (mQueue.size() || mQuit);
-        });
-        LOG_DEBUG_SAF("Dispatch notify received : %d, mQuit: %d", mQueue.size(), mQuit);
-        if (mQueue.size() && !mQuit)
-        {
-            auto request = mQueue.front();
-            mQueue.erase(mQueue.begin());
-            lock.unlock();
-            handleRequests(std::move(request));
-            lock.lock();
-        }
-    } while (!mQuit);
-}
-
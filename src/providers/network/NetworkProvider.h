@@ -23,7 +23,7 @@
 #include <map>
 #include <thread>
 #include <mutex>
-#include <condition_variable>
+#include <shared_mutex>
 #include <SAFErrors.h>
 #include <sys/mount.h>
 
@@ -36,7 +36,6 @@ public:
     NetworkProvider();
     virtual ~NetworkProvider();
     void addRequest(std::shared_ptr<RequestData>&);
-    void dispatchHandler();
     void handleRequests(std::shared_ptr<RequestData>);
     void mountSambaServer(std::shared_ptr<RequestData> reqData);
     void discoverUPnPMediaServer(std::shared_ptr<RequestData> reqData);
@@ -64,14 +63,12 @@ private:
     std::map<std::string, std::string> mntpathmap;
     bool validateSambaOperation(std::string, std::string);
     bool validateUpnpOperation(std::string, std::string);
+    bool isDriveKnown(const std::string&, const std::string&);
+    std::string getDrivePath(const std::string&, const std::string&);
     void setErrorMessage(shared_ptr<ValuePairMap>, std::string);
     bool validateExtraCommand(std::vector<std::string>, std::shared_ptr<RequestData>);
     std::map<std::string, std::string> mimetypesMap;
-    std::vector<std::shared_ptr<RequestData>> mQueue;
-    std::thread mDispatcherThread;
-    std::mutex mMutex;
-    std::condition_variable mCondVar;
-    volatile bool mQuit = false;
+    std::shared_mutex mStateMutex;
 
 };
 
@@ -10,6 +10,8 @@
  *
  * LICENSE@@@ */
 
+#include <sys/stat.h>
+#include <algorithm>
 #include <functional>
 #include <future>
 #include <pbnjson.hpp>
@@ -17,6 +19,11 @@
 #include "SA_Common.h"
 #include "SAFLunaService.h"
 #include "SAFUtilityOperation.h"
+#include "SAFWorkerPool.h"
+#include "DeviceQueues.h"
+#include "SAFCopyEngine.h"
+#include "TransferManager.h"
+#include "SizeIndex.h"
 #include "SAFErrors.h"
 #include "USBJsonParser.h"
 
@@ -26,17 +33,34 @@
 #define SAF_USB_FORMAT_METHOD  "luna://com.webos.service.pdm/format"
 #define SAF_USB_EJECT_METHOD   "luna://com.webos.service.pdm/eject"
 
-USBStorageProvider::USBStorageProvider() : mQuit(false)
+USBStorageProvider::USBStorageProvider() : mAttachToken(LSMESSAGE_TOKEN_INVALID)
 {
-    mDispatcherThread = std::thread(std::bind(&USBStorageProvider::dispatchHandler, this));
-    mDispatcherThread.detach();
-    deviceInfo = make_shared<USBAttached>();
+    cleanDeviceInfo();
+    startAttachWatch();
 }
 
 USBStorageProvider::~USBStorageProvider()
 {
-    mQuit = true;
-    mCondVar.notify_one();
+}
+
+// The profile copies to this drive use, looked up the same way the copy
+// does: by the filesystem type PDM registered for the volume, or by what
+// the mounted filesystem reports when PDM's name is not a known one
+static pbnjson::JValue getTransferProfile(const std::shared_ptr<USBDriveInfo>& drive)
+{
+    pbnjson::JValue profileObj = pbnjson::Object();
+    if (!drive)
+        return profileObj;
+    const TransferProfile* profile = &SAFCopyEngine::getPathProfile(drive->mMountPath);
+    profileObj.put("fsType", drive->mFsType);
+    profileObj.put("profile", profile->mName);
+    profileObj.put("chunkSize", (int64_t)profile->mChunkSize);
+    profileObj.put("bufferSize", (int64_t)profile->mBufferSize);
+    profileObj.put("syncInterval", (int64_t)profile->mSyncInterval);
+    profileObj.put("preallocate", profile->mPreallocate);
+    if (profile->mMaxFileSize)
+        profileObj.put("maxFileSize", (int64_t)profile->mMaxFileSize);
+    return profileObj;
 }
 
 void USBStorageProvider::getPropertiesMethod(std::shared_ptr<RequestData> data)
@@ -109,6 +133,16 @@ void USBStorageProvider::getPropertiesMethod(std::shared_ptr<RequestData> data)
             attrObj.put("LastModTimeStamp", propPtr->getLastModTime());
             attributesArr.append(attrObj);
             respObj.put("attributes", attributesArr);
+            respObj.put("totalSpaceBytes", (int64_t)propPtr->getCapacityBytes());
+            respObj.put("freeSpaceBytes", (int64_t)propPtr->getFreeSpaceBytes());
+            respObj.put("availableSpaceBytes", (int64_t)propPtr->getAvailSpaceBytes());
+            if (propPtr->hasTotals())
+            {
+                respObj.put("totalBytes", (int64_t)propPtr->getTotalBytes());
+                respObj.put("fileCount", (int64_t)propPtr->getFileCount());
+            }
+            respObj.put("transferProfile", getTransferProfile(findDrive(getDeviceInfo(),
+                ctxPtr->reqData->params["driveId"].asString())));
         }
         else
         {
@@ -140,50 +174,117 @@ void USBStorageProvider::getPropertiesMethod(std::shared_ptr<RequestData> data)
     }
 }
 
-void USBStorageProvider::listStoragesMethod(std::shared_ptr<RequestData> data)
+void USBStorageProvider::startAttachWatch()
 {
-    LOG_DEBUG_SAF("%s", __FUNCTION__);
-    std::string uri = SAF_USB_ATTACH_METHOD;
-    std::string payload = R"({"subscribe": true})";
+    std::lock_guard<std::mutex> lock(mAttachMutex);
+    if ((mAttachToken != LSMESSAGE_TOKEN_INVALID) || !SAFLunaService::lsHandle)
+        return;
     LSError lserror;
     (void)LSErrorInit(&lserror);
-    ReqContext* ctxPtr = new ReqContext();
-    ctxPtr->ctx = this;
-    ctxPtr->reqData = std::move(data);
-
-    pbnjson::JValue nextReqArray = pbnjson::Array();
-    pbnjson::JValue nextObj = pbnjson::Object();
-
-    nextObj.put("uri", uri);
-    nextObj.put("payload", payload);
-    nextReqArray.append(nextObj);
+    if (!LSCall(SAFLunaService::lsHandle, SAF_USB_ATTACH_METHOD, R"({"subscribe": true})",
+        USBStorageProvider::onListStoragesMethodReply, this, &mAttachToken, &lserror))
+    {
+        LOG_DEBUG_SAF("%s: cannot subscribe to PDM: %s", __FUNCTION__, lserror.message);
+        LSErrorFree(&lserror);
+        mAttachToken = LSMESSAGE_TOKEN_INVALID;
+    }
+}
 
-    LSCall(SAFLunaService::lsHandle, uri.c_str(), payload.c_str(),
-                USBStorageProvider::onListStoragesMethodReply, ctxPtr, NULL, &lserror);
+void USBStorageProvider::replyStorageList(const std::shared_ptr<RequestData>& reqData,
+    const std::shared_ptr<const USBAttached>& attached)
+{
+    // Subscribers are answered again on every change, so never touch their params
+    pbnjson::JValue params = reqData->params.duplicate();
+    params.put("response", attached->listResponse.duplicate());
+    params.put("storageType", "usb");
+    reqData->cb(params, reqData->subs);
 }
 
+void USBStorageProvider::listStoragesMethod(std::shared_ptr<RequestData> data)
+{
+    LOG_DEBUG_SAF("%s", __FUNCTION__);
+    startAttachWatch();
+    std::shared_ptr<const USBAttached> attached;
+    {
+        std::lock_guard<std::mutex> lock(mAttachMutex);
+        attached = getDeviceInfo();
+        // Answered by the first PDM reply, which is on its way
+        if (!attached->ready)
+        {
+            mPendingLists.push_back(std::move(data));
+            return;
+        }
+        if (data->params["subscribe"].asBool())
+        {
+            auto dropped = std::make_shared<std::atomic<bool>>(false);
+            data->subs->setCallback([dropped]() { *dropped = true; });
+            mAttachSubscribers.push_back({ data, dropped });
+        }
+    }
+    replyStorageList(data, attached);
+}
 
+// Every PDM update lands here: the registry is rebuilt, waiting requests are
+// answered and subscribed clients get the new list.
 bool USBStorageProvider::onListStoragesMethodReply(LSHandle *sh, LSMessage *message , void *ctx)
 {
     LOG_DEBUG_SAF("%s: [%s]", __FUNCTION__, LSMessageGetPayload(message));
-    LSError lserror;
-    (void)LSErrorInit(&lserror);
-    ReqContext *ctxPtr = static_cast<ReqContext*>(ctx);
-    USBStorageProvider* self = static_cast<USBStorageProvider*>(ctxPtr->ctx);
+    USBStorageProvider* self = static_cast<USBStorageProvider*>(ctx);
     pbnjson::JSchema parseSchema = pbnjson::JSchema::AllSchema();
     pbnjson::JDomParser parser;
     std::string payload = LSMessageGetPayload(message);
-    if (parser.parse(payload, parseSchema))
+    if (!parser.parse(payload, parseSchema))
+        return true;
+    pbnjson::JValue root = parser.getDom();
+    std::vector<std::shared_ptr<RequestData>> pending;
+    if (!root["returnValue"].asBool())
     {
-        pbnjson::JValue root = parser.getDom();
-        self->cleanDeviceInfo();
-        self->populateDeviceInfo(root);
-        USBPbnJsonParser usbParser;
-        pbnjson::JValue responseObj = usbParser.ParseListOfStorages(std::move(root));
-        ctxPtr->reqData->params.put("response", responseObj);
-        ctxPtr->reqData->params.put("storageType","usb");
-        ctxPtr->reqData->cb(ctxPtr->reqData->params, ctxPtr->reqData->subs);
+        // PDM went away: the last known devices stay, the next request
+        // subscribes again, and only callers still waiting for a first
+        // list are told it failed
+        {
+            std::lock_guard<std::mutex> lock(self->mAttachMutex);
+            LSError lserror;
+            (void)LSErrorInit(&lserror);
+            LSCallCancel(sh, self->mAttachToken, &lserror);
+            self->mAttachToken = LSMESSAGE_TOKEN_INVALID;
+            pending.swap(self->mPendingLists);
+        }
+        for (auto& reqData : pending)
+        {
+            pbnjson::JValue respObj = pbnjson::Object();
+            respObj.put("returnValue", false);
+            respObj.put("errorCode", SAFErrors::UNKNOWN_ERROR);
+            respObj.put("errorText", SAFErrors::USBErrors::getUSBErrorString(SAFErrors::UNKNOWN_ERROR));
+            reqData->cb(std::move(respObj), reqData->subs);
+        }
+        return true;
+    }
+    self->populateDeviceInfo(root);
+
+    std::vector<std::shared_ptr<RequestData>> subscribers;
+    {
+        std::lock_guard<std::mutex> lock(self->mAttachMutex);
+        auto& current = self->mAttachSubscribers;
+        current.erase(std::remove_if(current.begin(), current.end(),
+            [](const AttachSubscriber& subscriber) { return subscriber.mDropped->load(); }), current.end());
+        for (auto& subscriber : current)
+            subscribers.push_back(subscriber.mReqData);
+        pending.swap(self->mPendingLists);
+        for (auto& reqData : pending)
+        {
+            if (!reqData->params["subscribe"].asBool())
+                continue;
+            auto dropped = std::make_shared<std::atomic<bool>>(false);
+            reqData->subs->setCallback([dropped]() { *dropped = true; });
+            current.push_back({ reqData, dropped });
+        }
     }
+    auto attached = self->getDeviceInfo();
+    for (auto& reqData : pending)
+        self->replyStorageList(reqData, attached);
+    for (auto& reqData : subscribers)
+        self->replyStorageList(reqData, attached);
     return true;
 }
 
@@ -211,6 +312,41 @@ void USBStorageProvider::ejectMethod(std::shared_ptr<RequestData> data)
         return;
     }
 
+    // PDM unmounts every drive of the device, so all of them must be idle
+    std::vector<std::string> mountPaths;
+    uint64_t pendingBytes = 0;
+    size_t transfers = 0;
+    auto device = findDevice(getDeviceInfo(), data->params["driveId"].asString());
+    for (const auto& drive : device ? device->mStorageDriveList : std::vector<std::shared_ptr<USBDriveInfo>>())
+    {
+        struct stat driveStat;
+        if (!drive->mIsMounted || (stat(drive->mMountPath.c_str(), &driveStat) < 0))
+            continue;
+        uint64_t dirtyBytes = 0;
+        size_t driveTransfers = 0;
+        SAFCopyEngine::getInstance().getWriteBack(driveStat.st_dev, dirtyBytes, driveTransfers);
+        pendingBytes += dirtyBytes;
+        transfers += driveTransfers;
+        mountPaths.push_back(drive->mMountPath);
+    }
+    if (transfers > 0)
+    {
+        LOG_DEBUG_SAF("%s: %d transfers active, %llu bytes to flush", __FUNCTION__,
+            (int)transfers, (unsigned long long)pendingBytes);
+        pbnjson::JValue respObj = pbnjson::Object();
+        respObj.put("returnValue", false);
+        respObj.put("errorCode", SAFErrors::USBErrors::USB_DRIVE_BUSY);
+        respObj.put("errorText", SAFErrors::USBErrors::getUSBErrorString(SAFErrors::USBErrors::USB_DRIVE_BUSY));
+        respObj.put("activeTransfers", (int64_t)transfers);
+        respObj.put("pendingFlushBytes", (int64_t)pendingBytes);
+        data->cb(std::move(respObj), data->subs);
+        return;
+    }
+    // Copies have already flushed their files; this catches everything else
+    // written there, so PDM's unmount has nothing left to write back
+    for (const auto& mountPath : mountPaths)
+        SAFCopyEngine::getInstance().flushVolume(mountPath);
+
     std::string driveId = data->params["driveId"].asString();
     std::string uri = SAF_USB_EJECT_METHOD;
     std::string payload = "{\"deviceNum\": " + std::to_string(getStorageNumber(std::move(driveId))) + "}";
@@ -277,36 +413,26 @@ void USBStorageProvider::copyMethod(std::shared_ptr<RequestData> reqData)
     if (reqData->params.hasKey("overwrite"))
         overwrite = reqData->params["overwrite"].asBool();
 
-    std::unique_ptr<InternalCopy> copyPtr = SAFUtilityOperation::getInstance().copy(std::move(srcPath), std::move(destPath), overwrite);
+    std::shared_ptr<TransferJob> job = TransferManager::getInstance().getJob(reqData->params["jobId"].asString());
+    std::unique_ptr<InternalCopy> copyPtr = SAFUtilityOperation::getInstance().copy(std::move(srcPath), std::move(destPath), overwrite, job);
 
-    int retStatus = -1;
-    int prevStatus = -20;
+    // Progress is pushed by the job while the transfer runs; this is the final reply
+    int retStatus = copyPtr->getStatus();
+    bool status = (retStatus < 0)?(false):(true);
     pbnjson::JValue respObj = pbnjson::Object();
-    while(1)
+    respObj.put("returnValue", status);
+    if (status)
     {
-        retStatus = copyPtr->getStatus();
-        LOG_DEBUG_SAF("%s: statussss : %d", __FUNCTION__, retStatus);
-        bool status = (retStatus < 0)?(false):(true);
-        respObj.put("returnValue", status);
-        if (status)
-        {
-            respObj.put("progress", retStatus);
-        }
-        else
-        {
-            auto errorCode = getInternalErrorCode(copyPtr->getStatus());
-            auto errorStr  = SAFErrors::USBErrors::getUSBErrorString(errorCode);
-            respObj.put("errorCode", errorCode);
-            respObj.put("errorText", errorStr);
-        }
-        if (retStatus != prevStatus)
-            reqData->cb(respObj, reqData->subs);
-        if ((retStatus >= 100) || (retStatus < 0))
-            break;
-        else
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        prevStatus = retStatus;
+        respObj.put("progress", retStatus);
     }
+    else
+    {
+        auto errorCode = getInternalErrorCode(retStatus);
+        auto errorStr = SAFErrors::USBErrors::getUSBErrorString(errorCode);
+        respObj.put("errorCode", errorCode);
+        respObj.put("errorText", errorStr);
+    }
+    reqData->cb(std::move(respObj), reqData->subs);
 }
 
 void USBStorageProvider::moveMethod(std::shared_ptr<RequestData> reqData)
@@ -356,36 +482,26 @@ void USBStorageProvider::moveMethod(std::shared_ptr<RequestData> reqData)
     if (reqData->params.hasKey("overwrite"))
         overwrite = reqData->params["overwrite"].asBool();
 
-    std::unique_ptr<InternalMove> movePtr = SAFUtilityOperation::getInstance().move(std::move(srcPath), std::move(destPath), overwrite);
+    std::shared_ptr<TransferJob> job = TransferManager::getInstance().getJob(reqData->params["jobId"].asString());
+    std::unique_ptr<InternalMove> movePtr = SAFUtilityOperation::getInstance().move(std::move(srcPath), std::move(destPath), overwrite, job);
 
-    int retStatus = -1;
-    int prevStatus = -20;
-    while(1)
+    // Progress is pushed by the job while the transfer runs; this is the final reply
+    int retStatus = movePtr->getStatus();
+    bool status = (retStatus < 0)?(false):(true);
+    pbnjson::JValue respObj = pbnjson::Object();
+    respObj.put("returnValue", status);
+    if (status)
     {
-        retStatus = movePtr->getStatus();
-        LOG_DEBUG_SAF("%s: statussss : %d", __FUNCTION__, retStatus);
-        bool status = (retStatus < 0)?(false):(true);
-        pbnjson::JValue respObj = pbnjson::Object();
-        respObj.put("returnValue", status);
-        if (status)
-        {
-            respObj.put("progress", retStatus);
-        }
-        else
-        {
-            auto errorCode = getInternalErrorCode(movePtr->getStatus());
-            auto errorStr = SAFErrors::USBErrors::getUSBErrorString(errorCode);
-            respObj.put("errorCode", errorCode);
-            respObj.put("errorText", errorStr);
-        }
-        if (retStatus != prevStatus)
-            reqData->cb(std::move(respObj), reqData->subs);
-        if ((retStatus >= 100) || (retStatus < 0))
-            break;
-        else
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        prevStatus = retStatus;
+        respObj.put("progress", retStatus);
     }
+    else
+    {
+        auto errorCode = getInternalErrorCode(retStatus);
+        auto errorStr = SAFErrors::USBErrors::getUSBErrorString(errorCode);
+        respObj.put("errorCode", errorCode);
+        respObj.put("errorText", errorStr);
+    }
+    reqData->cb(std::move(respObj), reqData->subs);
 }
 
 void USBStorageProvider::removeMethod(std::shared_ptr<RequestData> reqData)
@@ -412,13 +528,92 @@ void USBStorageProvider::removeMethod(std::shared_ptr<RequestData> reqData)
         return;
     }
 
-    std::unique_ptr<InternalRemove> remPtr = SAFUtilityOperation::getInstance().remove(std::move(path));
-    bool status = (remPtr->getStatus() < 0)?(false):(true);
+    int32_t retStatus;
+    std::string trashId;
+    if (reqData->params.hasKey("trash") && reqData->params["trash"].asBool())
+    {
+        retStatus = SAFUtilityOperation::getInstance().moveToTrash(std::move(path),
+            getMountPath(reqData->params["driveId"].asString()), trashId);
+    }
+    else
+    {
+        std::string purgeRoot;
+        if (reqData->params.hasKey("detach") && reqData->params["detach"].asBool())
+            purgeRoot = getMountPath(reqData->params["driveId"].asString());
+        std::shared_ptr<TransferJob> job = TransferManager::getInstance().getJob(reqData->params["jobId"].asString());
+        std::unique_ptr<InternalRemove> remPtr = SAFUtilityOperation::getInstance().remove(std::move(path), job, std::move(purgeRoot));
+        retStatus = remPtr->getStatus();
+    }
+    bool status = (retStatus < 0)?(false):(true);
+    pbnjson::JValue respObj = pbnjson::Object();
+    respObj.put("returnValue", status);
+    if (status && !trashId.empty())
+    {
+        respObj.put("trashId", trashId);
+    }
+    else if (!status)
+    {
+        auto errorCode = getInternalErrorCode(retStatus);
+        auto errorStr  = SAFErrors::USBErrors::getUSBErrorString(errorCode);
+        respObj.put("errorCode", errorCode);
+        respObj.put("errorText", errorStr);
+    }
+    reqData->cb(std::move(respObj), reqData->subs);
+}
+
+void USBStorageProvider::restoreMethod(std::shared_ptr<RequestData> reqData)
+{
+    LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
     pbnjson::JValue respObj = pbnjson::Object();
+    std::string root = getMountPath(reqData->params["driveId"].asString());
+    if (root.empty())
+    {
+        respObj.put("returnValue", false);
+        respObj.put("errorCode", SAFErrors::USBErrors::DRIVE_NOT_MOUNTED);
+        respObj.put("errorText", SAFErrors::USBErrors::getUSBErrorString(SAFErrors::USBErrors::DRIVE_NOT_MOUNTED));
+        reqData->cb(std::move(respObj), reqData->subs);
+        return;
+    }
+    std::string trashId = reqData->params.hasKey("trashId") ? reqData->params["trashId"].asString() : "";
+    std::string path = reqData->params.hasKey("path") ? reqData->params["path"].asString() : "";
+    std::string restoredPath;
+    int32_t retStatus = SAFUtilityOperation::getInstance().restoreFromTrash(std::move(root),
+        std::move(trashId), std::move(path), restoredPath);
+    bool status = (retStatus < 0)?(false):(true);
+    respObj.put("returnValue", status);
+    if (status)
+    {
+        respObj.put("path", restoredPath);
+    }
+    else
+    {
+        auto errorCode = getInternalErrorCode(retStatus);
+        auto errorStr  = SAFErrors::USBErrors::getUSBErrorString(errorCode);
+        respObj.put("errorCode", errorCode);
+        respObj.put("errorText", errorStr);
+    }
+    reqData->cb(std::move(respObj), reqData->subs);
+}
+
+void USBStorageProvider::emptyTrashMethod(std::shared_ptr<RequestData> reqData)
+{
+    LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
+    pbnjson::JValue respObj = pbnjson::Object();
+    std::string root = getMountPath(reqData->params["driveId"].asString());
+    if (root.empty())
+    {
+        respObj.put("returnValue", false);
+        respObj.put("errorCode", SAFErrors::USBErrors::DRIVE_NOT_MOUNTED);
+        respObj.put("errorText", SAFErrors::USBErrors::getUSBErrorString(SAFErrors::USBErrors::DRIVE_NOT_MOUNTED));
+        reqData->cb(std::move(respObj), reqData->subs);
+        return;
+    }
+    int32_t retStatus = SAFUtilityOperation::getInstance().emptyTrash(std::move(root));
+    bool status = (retStatus < 0)?(false):(true);
     respObj.put("returnValue", status);
     if (!status)
     {
-        auto errorCode = getInternalErrorCode(remPtr->getStatus());
+        auto errorCode = getInternalErrorCode(retStatus);
         auto errorStr  = SAFErrors::USBErrors::getUSBErrorString(errorCode);
         respObj.put("errorCode", errorCode);
         respObj.put("errorText", errorStr);
@@ -429,8 +624,6 @@ void USBStorageProvider::removeMethod(std::shared_ptr<RequestData> reqData)
 void USBStorageProvider::listFolderContentsMethod(std::shared_ptr<RequestData> reqData)
 {
     std::string path = reqData->params["path"].asString();
-    int offset = reqData->params["offset"].asNumber<int>();
-    int limit = reqData->params["limit"].asNumber<int>();
 
     if(isStorageIdExists(reqData->params["driveId"].asString()) == false)
     {
@@ -453,28 +646,20 @@ void USBStorageProvider::listFolderContentsMethod(std::shared_ptr<RequestData> r
     }
 
     bool status = false;
-    int totalCount = 0;
-    std::string fullPath;
     pbnjson::JValue contenResArr = pbnjson::Array();
-    std::shared_ptr<FolderContents> contsPtr = SAFUtilityOperation::getInstance().getListFolderContents(std::move(path));
-    fullPath = contsPtr->getPath();
-    totalCount = contsPtr->getTotalCount();
-    if (contsPtr->getStatus() >= 0)
-    {
-        auto contVec = contsPtr->getContents();
-        int start = (offset > (int)contVec.size())?(contVec.size() + 1):(offset - 1);
-        start = (start < 0)?(contVec.size() + 1):(start);
-        int end = ((limit + offset - 1) >  contVec.size())?(contVec.size()):(limit + offset - 1);
-        end = (end < 0)?(contVec.size()):(end);
-        LOG_DEBUG_SAF("%s: start:%d, end: %d", __FUNCTION__,start,end);
-        for (int index = start; index < end; ++index)
+    FolderPage page = SAFUtilityOperation::getInstance().getFolderPage(reqData, std::move(path));
+    if (page.mStatus >= 0)
+    {
+        for (auto& content : page.mEntries)
         {
-            std::string size_str = std::to_string(contVec[index]->getSize());
             pbnjson::JValue contentObj = pbnjson::Object();
-            contentObj.put("name", contVec[index]->getName());
-            contentObj.put("path", contVec[index]->getPath());
-            contentObj.put("type", contVec[index]->getType());
-            contentObj.put("size", size_str);
+            contentObj.put("name", content.getName());
+            contentObj.put("path", content.getPath());
+            contentObj.put("type", content.getType());
+            if (content.hasSize())
+                contentObj.put("size", std::to_string(content.getSize()));
+            if (content.hasSize() && content.isDirectory())
+                contentObj.put("fileCount", (int64_t)content.getFileCount());
             contenResArr.append(contentObj);
         }
         status = true;
@@ -484,12 +669,14 @@ void USBStorageProvider::listFolderContentsMethod(std::shared_ptr<RequestData> r
     if (status)
     {
         respObj.put("files", contenResArr);
-        respObj.put("totalCount", totalCount);
-        respObj.put("fullPath", fullPath);
+        respObj.put("totalCount", (int)page.mTotalCount);
+        respObj.put("fullPath", page.mFullPath);
+        if (!page.mCursor.empty())
+            respObj.put("cursor", page.mCursor);
     }
     else
     {
-        auto errorCode = getInternalErrorCode(contsPtr->getStatus());
+        auto errorCode = getInternalErrorCode(page.mStatus);
         auto errorStr  = SAFErrors::USBErrors::getUSBErrorString(errorCode);
         respObj.put("errorCode", errorCode);
         respObj.put("errorText", errorStr);
@@ -539,11 +726,9 @@ void USBStorageProvider::renameMethod(std::shared_ptr<RequestData> reqData)
 
 void USBStorageProvider::addRequest(std::shared_ptr<RequestData>& reqData)
 {
-    {
-        std::unique_lock < std::mutex > lock(mMutex);
-        mQueue.push_back(std::move(reqData));
-    }
-    mCondVar.notify_one();
+    std::shared_ptr<RequestData> request = std::move(reqData);
+    DeviceQueues::getInstance().submit(DeviceQueues::getUSBDevices(request), SAFWorkerPool::getLane(request),
+        [this, request]() { handleRequests(request); });
 }
 
 bool USBStorageProvider::onReply(LSHandle *sh, LSMessage *message , void *ctx)
@@ -603,6 +788,8 @@ bool USBStorageProvider::onGetPropertiesReply(LSHandle *sh, LSMessage *message ,
     pbnjson::JDomParser parser;
     pbnjson::JValue typeObj = pbnjson::Object();
     typeObj.put("storageType", deviceType);
+    typeObj.put("transferProfile", getTransferProfile(self->findDrive(self->getDeviceInfo(),
+        ctxPtr->reqData->params["driveId"].asString())));
 
     std::string payload = LSMessageGetPayload(message);
     if (parser.parse(payload, parseSchema))
@@ -645,84 +832,66 @@ void USBStorageProvider::handleRequests(std::shared_ptr<RequestData> reqData)
         case MethodType::LIST_STORAGES_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::LIST_STORAGES_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->listStoragesMethod(reqData); });
-            (void)fut;
+            listStoragesMethod(reqData);
         }
         break;
         case MethodType::GET_PROP_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::GET_PROPERTIES_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->getPropertiesMethod(reqData); });
-            (void)fut;
+            getPropertiesMethod(reqData);
         }
         break;
         case MethodType::EJECT_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::EJECT_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->ejectMethod(reqData); });
-            (void)fut;
+            ejectMethod(reqData);
         }
         break;
         case MethodType::COPY_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::COPY_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->copyMethod(reqData); });
-            (void)fut;
+            copyMethod(reqData);
         }
         break;
         case MethodType::MOVE_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::MOVE_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->moveMethod(reqData); });
-            (void)fut;
+            moveMethod(reqData);
         }
         break;
         case MethodType::REMOVE_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::REMOVE_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->removeMethod(reqData); });
-            (void)fut;
+            removeMethod(reqData);
         }
         break;
         case MethodType::RENAME_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::RENAME_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->renameMethod(reqData); });
-            (void)fut;
+            renameMethod(reqData);
         }
         break;
         case MethodType::LIST_METHOD:
         {
             LOG_DEBUG_SAF("%s : MethodType::LIST_METHOD", __FUNCTION__);
-            auto fut = std::async(std::launch::async, [this, reqData]() { return this->listFolderContentsMethod(reqData); });
-            (void)fut;
+            listFolderContentsMethod(reqData);
         }
         break;
-        default:
+        case MethodType::RESTORE_METHOD:
+        {
+            LOG_DEBUG_SAF("%s : MethodType::RESTORE_METHOD", __FUNCTION__);
+            restoreMethod(reqData);
+        }
         break;
-    }
-}
-
-void USBStorageProvider::dispatchHandler()
-{
-    LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-    std::unique_lock < std::mutex > lock(mMutex, std::defer_lock);
-    lock.lock();
-    do {
-        mCondVar.wait(lock, [this] {
-            return (mQueue.size() || mQuit);
-        });
-        LOG_DEBUG_SAF("Dispatch notif received : %d, mQuit: %d", mQueue.size(), mQuit);
-        if (mQueue.size() && !mQuit)
+        case MethodType::EMPTY_TRASH_METHOD:
         {
-            auto request = mQueue.front();
-            mQueue.erase(mQueue.begin());
-            lock.unlock();
-            handleRequests(std::move(request));
-            lock.lock();
+            LOG_DEBUG_SAF("%s : MethodType::EMPTY_TRASH_METHOD", __FUNCTION__);
+            emptyTrashMethod(reqData);
         }
-    } while (!mQuit);
+        break;
+        default:
+        break;
+    }
 }
 
 void USBStorageProvider::populateDeviceInfo(pbnjson::JValue pbnObj)
@@ -749,6 +918,8 @@ void USBStorageProvider::populateDeviceInfo(pbnjson::JValue pbnObj)
         }
     }
 
+    auto attached = make_shared<USBAttached>();
+    std::map<std::string, std::string> volumeTypes;
     for(int i = 0; i < infoObj.arraySize(); i++)
     {
         shared_ptr<USBDeviceInfo> devPtr = make_shared<USBDeviceInfo>();
@@ -776,19 +947,38 @@ void USBStorageProvider::populateDeviceInfo(pbnjson::JValue pbnObj)
                     drivePtr->mVolumeLabel = infoObj[i]["storageDriveList"][j]["volumeLabel"].asString();
                 if(infoObj[i]["storageDriveList"][j].hasKey("isMounted"))
                     drivePtr->mIsMounted = infoObj[i]["storageDriveList"][j]["isMounted"].asBool();
+                if (drivePtr->mIsMounted && !drivePtr->mMountPath.empty())
+                {
+                    SizeIndex::getInstance().addRoot(drivePtr->mMountPath);
+                    volumeTypes[drivePtr->mMountPath] = drivePtr->mFsType;
+                }
                 devPtr->mStorageDriveList.push_back(drivePtr);
             }
         }
         if(infoObj[i].hasKey("serialNumber"))
-            deviceInfo->usbStorages[infoObj[i]["serialNumber"].asString()] = std::move(devPtr);
+        {
+            std::string serial = infoObj[i]["serialNumber"].asString();
+            devPtr->mSerialNumber = serial;
+            for (auto& drive : devPtr->mStorageDriveList)
+                attached->drives[serial + "-" + drive->mUuid] = drive;
+            if (devPtr->mStorageDriveList.size() == 1)
+                attached->drives[serial] = devPtr->mStorageDriveList[0];
+            attached->usbStorages[serial] = std::move(devPtr);
+        }
     }
+    USBPbnJsonParser usbParser;
+    attached->listResponse = usbParser.ParseListOfStorages(std::move(pbnObj));
+    attached->ready = true;
+    // Copies onto these volumes take their profile from PDM's type, not a guess from statfs
+    SAFCopyEngine::getInstance().setVolumeTypes(volumeTypes);
+    std::atomic_store(&deviceInfo, std::shared_ptr<const USBAttached>(std::move(attached)));
 }
 
 void USBStorageProvider::printUSBInfo()
 {
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
-    std::map<std::string, std::shared_ptr<USBDeviceInfo>>::iterator it;
-    for (it = deviceInfo->usbStorages.begin(); it != deviceInfo->usbStorages.end(); ++it)
+    auto attached = getDeviceInfo();
+    for (auto it = attached->usbStorages.begin(); it != attached->usbStorages.end(); ++it)
     {
         LOG_DEBUG_SAF("USB Serial %s::StorageType:%s StorageNumber:%d SetId:%s",
             (it->first).c_str(), (it->second->mStorageType).c_str(),
@@ -807,210 +997,67 @@ void USBStorageProvider::printUSBInfo()
     }
 }
 
+std::shared_ptr<USBDeviceInfo> USBStorageProvider::findDevice(const std::shared_ptr<const USBAttached>& attached,
+    const std::string& driveId)
+{
+    auto it = attached->usbStorages.find(driveId.substr(0, driveId.find("-")));
+    return (it == attached->usbStorages.end()) ? nullptr : it->second;
+}
+
+std::shared_ptr<USBDriveInfo> USBStorageProvider::findDrive(const std::shared_ptr<const USBAttached>& attached,
+    const std::string& driveId)
+{
+    auto it = attached->drives.find(driveId);
+    return (it == attached->drives.end()) ? nullptr : it->second;
+}
+
 std::string USBStorageProvider::getDriveName(std::string driveId)
 {
-    std::string mainId = "";
-    std::string subId  = "";
-    int subIndex = driveId.find("-");
-    if(subIndex != std::string::npos)
-    {
-        mainId = driveId.substr(0,subIndex);
-        subId  = driveId.substr(subIndex + 1, driveId.length() - 1);
-    }
-    else
-    {
-        mainId = std::move(driveId);
-    }
-    return getDriveName(std::move(mainId), std::move(subId));
+    auto attached = getDeviceInfo();
+    auto drive = findDrive(attached, driveId);
+    if (drive)
+        return drive->mDriveName;
+    // Tell apart a partition that is missing from one that was not named
+    auto device = findDevice(attached, driveId);
+    if (!device)
+        return "";
+    if (driveId.find("-") != std::string::npos)
+        return "NO SUB";
+    return (device->mStorageDriveList.size() > 1) ? "UUID" : "";
 }
 
-std::string USBStorageProvider::getDriveName(std::string driveId, std::string subId)
+std::string USBStorageProvider::getMountPath(std::string driveId)
 {
-    std::map<std::string, std::shared_ptr<USBDeviceInfo>>::iterator it;
-    std::string usbDriveName = "";
-    for (it = deviceInfo->usbStorages.begin(); it != deviceInfo->usbStorages.end(); ++it)
-    {
-        if((it->first).compare(driveId) == 0)
-        {
-            if(subId.empty() && it->second->mStorageDriveList.size() == 1)
-            {
-                usbDriveName = it->second->mStorageDriveList[0]->mDriveName;
-                break;
-            }
-            else if(!subId.empty() && it->second->mStorageDriveList.size() == 1)
-            {
-                if((it->second->mStorageDriveList[0]->mUuid).compare(subId) == 0)
-                    usbDriveName = it->second->mStorageDriveList[0]->mDriveName;
-                else
-                    usbDriveName = "NO SUB";
-                break;
-            }
-            else if(!subId.empty() && it->second->mStorageDriveList.size() > 1)
-            {
-                for(int k = 0; k < it->second->mStorageDriveList.size(); k++)
-                {
-                    if((it->second->mStorageDriveList[k]->mUuid).compare(subId) == 0)
-                    {
-                        usbDriveName = it->second->mStorageDriveList[k]->mDriveName;
-                        break;
-                    }
-                }
-                if(usbDriveName.empty())
-                {
-                    usbDriveName = "NO SUB";
-                    break;
-                }
-            }
-            else if(subId.empty() && it->second->mStorageDriveList.size() > 1)
-            {
-                usbDriveName = "UUID";
-            }
-        }
-    }
-    return usbDriveName;
+    auto drive = findDrive(getDeviceInfo(), driveId);
+    if (drive && drive->mIsMounted)
+        return drive->mMountPath;
+    return "";
 }
 
 bool USBStorageProvider::isStorageIdExists(std::string driveId)
 {
-    std::string mainId = "";
-    std::string subId  = "";
-    int subIndex = driveId.find("-");
-    if(subIndex != std::string::npos)
-    {
-        mainId = driveId.substr(0,subIndex);
-        subId  = driveId.substr(subIndex + 1, driveId.length() - 1);
-    }
-    else
-    {
-        mainId = std::move(driveId);
-    }
-    std::map<std::string, std::shared_ptr<USBDeviceInfo>>::iterator it;
-    for (it = deviceInfo->usbStorages.begin(); it != deviceInfo->usbStorages.end(); ++it)
-    {
-        if((it->first).compare(mainId) == 0)
-        {
-            if(subId.empty() && it->second->mStorageDriveList.size() == 1)
-            {
-                return true;
-            }
-            else if(!subId.empty() && it->second->mStorageDriveList.size() == 1)
-            {
-                if((it->second->mStorageDriveList[0]->mUuid).compare(subId) == 0)
-                {
-                    return true;
-                }
-            }
-            else if(!subId.empty() && it->second->mStorageDriveList.size() > 1)
-            {
-                for(int k = 0; k < it->second->mStorageDriveList.size(); k++)
-                {
-                    if((it->second->mStorageDriveList[k]->mUuid).compare(subId) == 0)
-                    {
-                        return true;
-                    }
-                }
-            }
-        }
-    }
-    return false;
+    return (findDrive(getDeviceInfo(), driveId) != nullptr);
 }
 
 bool USBStorageProvider::isStorageDriveMounted(std::string actualDevId)
 {
-    std::string mainId = "";
-    std::string subId  = "";
-    int subIndex = actualDevId.find("-");
-    if(subIndex != std::string::npos)
-    {
-        mainId = actualDevId.substr(0,subIndex);
-        subId  = actualDevId.substr(subIndex + 1, actualDevId.length() - 1);
-    }
-    else
-    {
-        mainId = std::move(actualDevId);
-    }
-    std::map<std::string, std::shared_ptr<USBDeviceInfo>>::iterator it;
-    for (it = deviceInfo->usbStorages.begin(); it != deviceInfo->usbStorages.end(); ++it)
-    {
-        if((it->first).compare(mainId) == 0)
-        {
-            if(subId.empty() && it->second->mStorageDriveList.size() == 1)
-            {
-                return it->second->mStorageDriveList[0]->mIsMounted;
-            }
-            else if(!subId.empty() && it->second->mStorageDriveList.size() == 1)
-            {
-                if((it->second->mStorageDriveList[0]->mUuid).compare(subId) == 0)
-                {
-                    return it->second->mStorageDriveList[0]->mIsMounted;
-                }
-            }
-            else if(!subId.empty() && it->second->mStorageDriveList.size() > 1)
-            {
-                for(int k = 0; k < it->second->mStorageDriveList.size(); k++)
-                {
-                    if((it->second->mStorageDriveList[k]->mUuid).compare(subId) == 0)
-                    {
-                        return it->second->mStorageDriveList[k]->mIsMounted;
-                    }
-                }
-            }
-        }
-    }
-    return false;
+    auto drive = findDrive(getDeviceInfo(), actualDevId);
+    return drive && drive->mIsMounted;
 }
 
 int USBStorageProvider::getStorageNumber(std::string actualDevId)
 {
-    std::string mainId = "";
-    std::string subId  = "";
-    int subIndex = actualDevId.find("-");
-    if(subIndex != std::string::npos)
-    {
-        mainId = actualDevId.substr(0,subIndex);
-    }
-    else
-    {
-        mainId = std::move(actualDevId);
-    }
-    std::map<std::string, std::shared_ptr<USBDeviceInfo>>::iterator it;
-    for (it = deviceInfo->usbStorages.begin(); it != deviceInfo->usbStorages.end(); ++it)
-    {
-        if((it->first).compare(mainId) == 0)
-        {
-            return it->second->mDeviceNumber;
-        }
-    }
-    return 0;
+    auto device = findDevice(getDeviceInfo(), actualDevId);
+    return device ? device->mDeviceNumber : 0;
 }
 
- std::string USBStorageProvider::getStorageType(std::string actualDevId)
- {
-    std::string mainId = "";
-    std::string subId  = "";
-    int subIndex = actualDevId.find("-");
-    if(subIndex != std::string::npos)
-    {
-        mainId = actualDevId.substr(0,subIndex);
-    }
-    else
-    {
-        mainId = std::move(actualDevId);
-    }
-    std::map<std::string, std::shared_ptr<USBDeviceInfo>>::iterator it;
-    for (it = deviceInfo->usbStorages.begin(); it != deviceInfo->usbStorages.end(); ++it)
-    {
-        if((it->first).compare(mainId) == 0)
-        {
-            return it->second->mStorageType;
-        }
-    }
-    return "";
- }
-
- void USBStorageProvider::cleanDeviceInfo()
- {
-    deviceInfo.reset();
-    deviceInfo = make_shared<USBAttached>();
- }
+std::string USBStorageProvider::getStorageType(std::string actualDevId)
+{
+    auto device = findDevice(getDeviceInfo(), actualDevId);
+    return device ? device->mStorageType : "";
+}
 
+void USBStorageProvider::cleanDeviceInfo()
+{
+    std::atomic_store(&deviceInfo, std::shared_ptr<const USBAttached>(make_shared<USBAttached>()));
+}
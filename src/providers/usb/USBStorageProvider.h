@@ -15,12 +15,13 @@
 
 #include "DocumentProvider.h"
 #include "DocumentProviderFactory.h"
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <map>
-#include <thread>
-#include <mutex>
-#include <condition_variable>
+#include <unordered_map>
 #include <luna-service2/lunaservice.hpp>
 #include <pbnjson.hpp>
 
@@ -32,7 +33,7 @@ public :
     string mFsType;
     string mUuid;
     string mVolumeLabel;
-    bool mIsMounted;
+    bool mIsMounted = false;
 };
 
 class USBDeviceInfo
@@ -40,15 +41,25 @@ class USBDeviceInfo
 public :
     string mStorageType;
     string mSerialNumber;
-    int mDeviceNumber;
+    int mDeviceNumber = 0;
     string mDeviceSetId;
     vector<shared_ptr<USBDriveInfo>> mStorageDriveList;
 };
 
+// One immutable view of the attached devices. A new one is built for every
+// PDM update and published whole, so a request holding a snapshot never
+// sees a half-updated list.
 class USBAttached
 {
 public:
     std::map<std::string, std::shared_ptr<USBDeviceInfo>> usbStorages;
+    // By driveId: "serial-uuid" for every drive, plain "serial" as well
+    // when the device has a single drive
+    std::unordered_map<std::string, std::shared_ptr<USBDriveInfo>> drives;
+    // The USB part of listStorageProviders, built once per update
+    pbnjson::JValue listResponse;
+    // False until PDM has answered once
+    bool ready = false;
 };
 
 class USBStorageProvider: public DocumentProvider
@@ -57,7 +68,6 @@ public:
     USBStorageProvider();
     virtual ~USBStorageProvider();
 	void addRequest(std::shared_ptr<RequestData>&);
-    void dispatchHandler();
     void handleRequests(std::shared_ptr<RequestData>);
     void listStoragesMethod(std::shared_ptr<RequestData>);
     void getPropertiesMethod(std::shared_ptr<RequestData>);
@@ -65,12 +75,14 @@ public:
     void copyMethod(std::shared_ptr<RequestData>);
     void moveMethod(std::shared_ptr<RequestData>);
     void removeMethod(std::shared_ptr<RequestData>);
+    void restoreMethod(std::shared_ptr<RequestData>);
+    void emptyTrashMethod(std::shared_ptr<RequestData>);
     void renameMethod(std::shared_ptr<RequestData>);
     void listFolderContentsMethod(std::shared_ptr<RequestData>);
     void populateDeviceInfo(pbnjson::JValue);
     void printUSBInfo();
     std::string getDriveName(std::string);
-    std::string getDriveName(std::string, std::string);
+    std::string getMountPath(std::string);
     std::string getStorageType(std::string);
     bool isStorageIdExists(std::string);
     void cleanDeviceInfo();
@@ -81,12 +93,24 @@ public:
     static bool onListStoragesMethodReply(LSHandle*, LSMessage*, void*);
 
 private:
-    std::vector<std::shared_ptr<RequestData>> mQueue;
-    std::thread mDispatcherThread;
-    std::mutex mMutex;
-    std::condition_variable mCondVar;
-    volatile bool mQuit;
-    std::shared_ptr<USBAttached> deviceInfo;
+    struct AttachSubscriber
+    {
+        std::shared_ptr<RequestData> mReqData;
+        std::shared_ptr<std::atomic<bool>> mDropped;
+    };
+
+    void startAttachWatch();
+    void replyStorageList(const std::shared_ptr<RequestData>&, const std::shared_ptr<const USBAttached>&);
+    // Readers take the current snapshot without locking; updates replace it
+    std::shared_ptr<const USBAttached> getDeviceInfo() { return std::atomic_load(&deviceInfo); }
+    std::shared_ptr<USBDeviceInfo> findDevice(const std::shared_ptr<const USBAttached>&, const std::string&);
+    std::shared_ptr<USBDriveInfo> findDrive(const std::shared_ptr<const USBAttached>&, const std::string&);
+    std::shared_ptr<const USBAttached> deviceInfo;
+    // One PDM subscription for the life of the service feeds deviceInfo
+    std::mutex mAttachMutex;
+    LSMessageToken mAttachToken;
+    std::vector<std::shared_ptr<RequestData>> mPendingLists;
+    std::vector<AttachSubscriber> mAttachSubscribers;
 };
 
 #endif /* _USB_STORAGE_PROVIDER_H_ */
@@ -0,0 +1,156 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#include <algorithm>
+#include <set>
+#include <utility>
+#include "SAFLog.h"
+#include "DeviceQueues.h"
+
+#define SAF_USB_BULK_PER_DEVICE 1
+#define SAF_USB_INTERACTIVE_PER_DEVICE 2
+
+DeviceQueues::DeviceQueues(size_t maxBulk, size_t maxInteractive)
+    : mMaxBulk(maxBulk), mMaxInteractive(maxInteractive)
+{
+}
+
+DeviceQueues& DeviceQueues::getInstance()
+{
+    // One bulk stream and a couple of interactive requests per stick at a time
+    static DeviceQueues obj(SAF_USB_BULK_PER_DEVICE, SAF_USB_INTERACTIVE_PER_DEVICE);
+    return obj;
+}
+
+std::vector<std::string> DeviceQueues::getUSBDevices(const std::shared_ptr<RequestData>& reqData)
+{
+    // Queues are per physical device: every partition of a stick shares its serial
+    std::vector<std::string> devices;
+    auto addDevice = [&devices](const std::string& driveId) {
+        if (!driveId.empty())
+            devices.push_back(driveId.substr(0, driveId.find("-")));
+    };
+    if (reqData->params.hasKey("driveId") && (reqData->storageType == StorageType::USB))
+        addDevice(reqData->params["driveId"].asString());
+    if (reqData->params.hasKey("srcDriveId") && (reqData->params["srcStorageType"] == "usb"))
+        addDevice(reqData->params["srcDriveId"].asString());
+    if (reqData->params.hasKey("destDriveId") && (reqData->params["destStorageType"] == "usb"))
+        addDevice(reqData->params["destDriveId"].asString());
+    return devices;
+}
+
+void DeviceQueues::submit(std::vector<std::string> devices, TaskLane lane, Task task)
+{
+    std::sort(devices.begin(), devices.end());
+    devices.erase(std::unique(devices.begin(), devices.end()), devices.end());
+    if (devices.empty())
+    {
+        SAFWorkerPool::getInstance().submit(std::move(task), lane);
+        return;
+    }
+    std::vector<Pending> ready;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Pending pending;
+        pending.mDevices = std::move(devices);
+        pending.mLane = lane;
+        pending.mTask = std::move(task);
+        mPending.push_back(std::move(pending));
+        ready = takeReady();
+        if (ready.empty())
+        {
+            LOG_DEBUG_SAF("%s: queued behind device, %d waiting", __FUNCTION__, (int)mPending.size());
+        }
+    }
+    start(std::move(ready));
+}
+
+bool DeviceQueues::hasRoom(const std::string& device, TaskLane lane)
+{
+    auto itr = mSlots.find(device);
+    if (itr == mSlots.end())
+        return true;
+    if (lane == TaskLane::BULK)
+        return itr->second.mBulk < mMaxBulk;
+    return itr->second.mInteractive < mMaxInteractive;
+}
+
+std::vector<DeviceQueues::Pending> DeviceQueues::takeReady()
+{
+    std::vector<Pending> ready;
+    // A device/lane that made one task wait makes every later task on it wait,
+    // so a request never overtakes an earlier one on the same device
+    std::set<std::pair<std::string, TaskLane>> blocked;
+    for (auto itr = mPending.begin(); itr != mPending.end();)
+    {
+        bool runnable = true;
+        for (const auto& device : itr->mDevices)
+        {
+            if (blocked.count(std::make_pair(device, itr->mLane)) || !hasRoom(device, itr->mLane))
+                runnable = false;
+        }
+        if (!runnable)
+        {
+            for (const auto& device : itr->mDevices)
+                blocked.insert(std::make_pair(device, itr->mLane));
+            ++itr;
+            continue;
+        }
+        for (const auto& device : itr->mDevices)
+        {
+            Slots& slots = mSlots[device];
+            if (itr->mLane == TaskLane::BULK)
+                ++slots.mBulk;
+            else
+                ++slots.mInteractive;
+        }
+        ready.push_back(std::move(*itr));
+        itr = mPending.erase(itr);
+    }
+    return ready;
+}
+
+void DeviceQueues::start(std::vector<Pending> ready)
+{
+    for (auto& pending : ready)
+    {
+        auto devices = std::move(pending.mDevices);
+        TaskLane lane = pending.mLane;
+        auto task = std::move(pending.mTask);
+        SAFWorkerPool::getInstance().submit([this, devices, lane, task]() {
+            task();
+            finish(devices, lane);
+        }, lane);
+    }
+}
+
+void DeviceQueues::finish(const std::vector<std::string>& devices, TaskLane lane)
+{
+    std::vector<Pending> ready;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& device : devices)
+        {
+            auto itr = mSlots.find(device);
+            if (itr == mSlots.end())
+                continue;
+            if (lane == TaskLane::BULK)
+                --itr->second.mBulk;
+            else
+                --itr->second.mInteractive;
+            if ((itr->second.mBulk == 0) && (itr->second.mInteractive == 0))
+                mSlots.erase(itr);
+        }
+        ready = takeReady();
+    }
+    start(std::move(ready));
+}
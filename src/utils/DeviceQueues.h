@@ -0,0 +1,74 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#ifndef _DEVICE_QUEUES_H_
+#define _DEVICE_QUEUES_H_
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "SAFWorkerPool.h"
+
+/*
+ * Admission in front of SAFWorkerPool for requests bound to physical devices.
+ * Each device key runs at most maxBulk bulk and maxInteractive interactive
+ * tasks at once; everything over that waits here, in arrival order per
+ * device and lane, without holding a worker. A task naming several devices
+ * (a copy between two sticks) starts only when all of them have room, and
+ * tasks on other devices are never held up behind it.
+ * One instance serves the USB sticks for every provider, so a copy from
+ * internal storage to a stick waits behind the stick's own bulk work.
+ */
+class DeviceQueues
+{
+public:
+    typedef SAFWorkerPool::Task Task;
+
+    static DeviceQueues& getInstance();
+    // The USB sticks a request reads or writes, by device serial
+    static std::vector<std::string> getUSBDevices(const std::shared_ptr<RequestData>& reqData);
+    // Tasks naming no device go straight to the pool
+    void submit(std::vector<std::string> devices, TaskLane lane, Task task);
+
+private:
+    struct Pending
+    {
+        std::vector<std::string> mDevices;
+        TaskLane mLane;
+        Task mTask;
+    };
+
+    struct Slots
+    {
+        size_t mBulk = 0;
+        size_t mInteractive = 0;
+    };
+
+    DeviceQueues(size_t maxBulk, size_t maxInteractive);
+    DeviceQueues(const DeviceQueues&) = delete;
+    DeviceQueues& operator=(const DeviceQueues&) = delete;
+    bool hasRoom(const std::string& device, TaskLane lane);
+    std::vector<Pending> takeReady();
+    void start(std::vector<Pending> ready);
+    void finish(const std::vector<std::string>& devices, TaskLane lane);
+
+    size_t mMaxBulk;
+    size_t mMaxInteractive;
+    std::mutex mMutex;
+    std::deque<Pending> mPending;
+    std::map<std::string, Slots> mSlots;
+};
+
+#endif /* _DEVICE_QUEUES_H_ */
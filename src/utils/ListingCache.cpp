@@ -0,0 +1,182 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <filesystem>
+#include "SAFLog.h"
+#include "ListingCache.h"
+
+#define SAF_LISTING_CACHE_BUDGET (8 * 1024 * 1024)
+#define SAF_LISTING_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB \
+    | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+ListingCache::ListingCache() : mBytes(0)
+{
+    mInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mInotifyFd < 0)
+        LOG_DEBUG_SAF("%s: inotify unavailable (%s), listings are not cached", __FUNCTION__, strerror(errno));
+}
+
+ListingCache& ListingCache::getInstance()
+{
+    static ListingCache obj;
+    return obj;
+}
+
+std::string ListingCache::getSignature(const ListOptions& options)
+{
+    std::string signature = std::to_string(static_cast<int>(options.mSortBy))
+        + (options.mDescending ? "d" : "a") + "|" + options.mType + "|" + options.mNamePattern;
+    for (auto& extension : options.mExtensions)
+        signature += "|" + extension;
+    return signature;
+}
+
+std::shared_ptr<FolderContents> ListingCache::get(const std::string& path, const ListOptions& options)
+{
+    // Recursive sizes change without any event in the folder itself
+    if ((mInotifyFd < 0) || options.mWithDirSize)
+        return std::make_shared<FolderContents>(path, options);
+
+    std::string dir = std::filesystem::path(path).lexically_normal().string();
+    std::string key = dir + '\n' + getSignature(options);
+    int wd = -1;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        drainEvents();
+        auto itr = mEntries.find(key);
+        if (itr != mEntries.end())
+        {
+            mLru.splice(mLru.begin(), mLru, itr->second.mLruPos);
+            return itr->second.mContents;
+        }
+        // Watch before reading, so a change racing the readdir is not missed
+        wd = inotify_add_watch(mInotifyFd, dir.c_str(), SAF_LISTING_WATCH_MASK);
+        if (wd < 0)
+        {
+            LOG_DEBUG_SAF("%s: cannot watch %s: %s", __FUNCTION__, dir.c_str(), strerror(errno));
+            return std::make_shared<FolderContents>(path, options);
+        }
+        mWatchDirs[wd].insert(dir);
+        mDirWatches[dir] = wd;
+    }
+
+    auto contents = std::make_shared<FolderContents>(path, options);
+    std::size_t bytes = contents->getMemoryUsage();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    drainEvents();
+    auto watch = mWatchDirs.find(wd);
+    bool changed = (watch == mWatchDirs.end()) || (watch->second.count(dir) == 0);
+    if (changed || (contents->getStatus() < 0) || (bytes > SAF_LISTING_CACHE_BUDGET)
+        || (mEntries.find(key) != mEntries.end()))
+    {
+        releaseWatch(dir);
+        return contents;
+    }
+    mLru.push_front(key);
+    mEntries[key] = { dir, contents, bytes, mLru.begin() };
+    mBytes += bytes;
+    while (mBytes > SAF_LISTING_CACHE_BUDGET)
+        erase(mEntries.find(mLru.back()));
+    return contents;
+}
+
+void ListingCache::drainEvents()
+{
+    alignas(struct inotify_event) char buffer[4096];
+    while (true)
+    {
+        ssize_t len = read(mInotifyFd, buffer, sizeof(buffer));
+        if (len <= 0)
+            break;
+        for (char *ptr = buffer; ptr < buffer + len;)
+        {
+            struct inotify_event *event = reinterpret_cast<struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // Events were lost, so nothing cached can be trusted
+                LOG_DEBUG_SAF("%s: inotify queue overflow, dropping all listings", __FUNCTION__);
+                while (!mWatchDirs.empty())
+                    dropWatch(mWatchDirs.begin()->first);
+                continue;
+            }
+            if (mWatchDirs.find(event->wd) != mWatchDirs.end())
+                dropWatch(event->wd);
+        }
+    }
+}
+
+void ListingCache::dropWatch(int wd)
+{
+    auto watch = mWatchDirs.find(wd);
+    if (watch == mWatchDirs.end())
+        return;
+    std::set<std::string> dirs = std::move(watch->second);
+    mWatchDirs.erase(watch);
+    for (auto& dir : dirs)
+    {
+        mDirWatches.erase(dir);
+        dropDir(dir);
+    }
+    // Already gone if the folder was deleted or unmounted; that is fine
+    inotify_rm_watch(mInotifyFd, wd);
+}
+
+void ListingCache::dropDir(const std::string& dir)
+{
+    std::string prefix = dir + '\n';
+    auto itr = mEntries.lower_bound(prefix);
+    while ((itr != mEntries.end()) && (itr->first.compare(0, prefix.size(), prefix) == 0))
+    {
+        auto next = std::next(itr);
+        mBytes -= itr->second.mBytes;
+        mLru.erase(itr->second.mLruPos);
+        mEntries.erase(itr);
+        itr = next;
+    }
+}
+
+void ListingCache::releaseWatch(const std::string& dir)
+{
+    std::string prefix = dir + '\n';
+    auto itr = mEntries.lower_bound(prefix);
+    if ((itr != mEntries.end()) && (itr->first.compare(0, prefix.size(), prefix) == 0))
+        return;
+    auto dirWatch = mDirWatches.find(dir);
+    if (dirWatch == mDirWatches.end())
+        return;
+    int wd = dirWatch->second;
+    mDirWatches.erase(dirWatch);
+    auto watch = mWatchDirs.find(wd);
+    if (watch == mWatchDirs.end())
+        return;
+    watch->second.erase(dir);
+    if (watch->second.empty())
+    {
+        mWatchDirs.erase(watch);
+        inotify_rm_watch(mInotifyFd, wd);
+    }
+}
+
+void ListingCache::erase(std::map<std::string, Entry>::iterator itr)
+{
+    std::string dir = itr->second.mDir;
+    mBytes -= itr->second.mBytes;
+    mLru.erase(itr->second.mLruPos);
+    mEntries.erase(itr);
+    releaseWatch(dir);
+}
@@ -0,0 +1,67 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#ifndef _LISTING_CACHE_H_
+#define _LISTING_CACHE_H_
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include "SAFUtilityOperation.h"
+
+/*
+ * Recently listed folders, kept in memory up to a byte budget and evicted
+ * least recently used first. Every cached folder carries an inotify watch;
+ * any create, delete, move, attribute change or finished write inside it
+ * drops its listings. Pending events are drained before each lookup, so a
+ * change is visible to the very next list without a watcher thread.
+ * Only local filesystems belong here: inotify does not see changes made on
+ * the far side of a network mount.
+ */
+class ListingCache
+{
+public:
+    static ListingCache& getInstance();
+    std::shared_ptr<FolderContents> get(const std::string& path, const ListOptions& options);
+
+private:
+    struct Entry
+    {
+        std::string mDir;
+        std::shared_ptr<FolderContents> mContents;
+        std::size_t mBytes;
+        std::list<std::string>::iterator mLruPos;
+    };
+
+    ListingCache();
+    ListingCache(const ListingCache&) = delete;
+    ListingCache& operator=(const ListingCache&) = delete;
+    static std::string getSignature(const ListOptions& options);
+    void drainEvents();
+    void dropDir(const std::string& dir);
+    void dropWatch(int wd);
+    void releaseWatch(const std::string& dir);
+    void erase(std::map<std::string, Entry>::iterator itr);
+
+    std::mutex mMutex;
+    int mInotifyFd;
+    std::size_t mBytes;
+    std::map<std::string, Entry> mEntries;
+    std::list<std::string> mLru;
+    std::map<int, std::set<std::string>> mWatchDirs;
+    std::map<std::string, int> mDirWatches;
+};
+
+#endif /* _LISTING_CACHE_H_ */
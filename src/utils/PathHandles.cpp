@@ -0,0 +1,249 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#if __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#endif
+#include "SAFLog.h"
+#include "PathHandles.h"
+
+#ifndef RESOLVE_BENEATH
+struct open_how
+{
+    uint64_t flags;
+    uint64_t mode;
+    uint64_t resolve;
+};
+#define RESOLVE_NO_MAGICLINKS 0x02
+#define RESOLVE_BENEATH 0x08
+#endif
+#ifndef SYS_openat2
+#define SYS_openat2 437
+#endif
+
+static bool isUnder(const std::string& path, const std::string& root)
+{
+    return (path.compare(0, root.size(), root) == 0)
+        && ((path.size() == root.size()) || (path[root.size()] == '/'));
+}
+
+PathHandles::RootHandle::~RootHandle()
+{
+    close(mFd);
+}
+
+PathHandles& PathHandles::getInstance()
+{
+    static PathHandles obj;
+    return obj;
+}
+
+std::string PathHandles::findRoot(const std::string& path)
+{
+    for (const char *root : { "/media", "/tmp" })
+    {
+        if (isUnder(path, root))
+            return root;
+    }
+    if (path.compare(0, 6, "/home/") != 0)
+        return "";
+    std::string user = path.substr(6, path.find('/', 6) - 6);
+    if (user.empty() || (user == ".") || (user == ".."))
+        return "";
+    return "/home/" + user;
+}
+
+std::shared_ptr<PathHandles::RootHandle> PathHandles::getRoot(const std::string& root, bool reopen)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto itr = mRoots.find(root);
+    if ((itr != mRoots.end()) && !reopen)
+        return itr->second;
+    struct stat rootStat;
+    if (stat(root.c_str(), &rootStat) < 0)
+        return nullptr;
+    // Only replaced when the root itself was removed and created again
+    if ((itr != mRoots.end()) && (itr->second->mDev == rootStat.st_dev) && (itr->second->mIno == rootStat.st_ino))
+        return itr->second;
+    int fd = ::open(root.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+    auto handle = std::make_shared<RootHandle>();
+    handle->mFd = fd;
+    if (fstat(fd, &rootStat) < 0)
+        return nullptr;
+    handle->mDev = rootStat.st_dev;
+    handle->mIno = rootStat.st_ino;
+    char realPath[PATH_MAX];
+    handle->mRealPath = realpath(root.c_str(), realPath) ? realPath : root;
+    mRoots[root] = handle;
+    return handle;
+}
+
+int PathHandles::openBeneath(const RootHandle& handle, const std::string& relPath, int flags)
+{
+    if (mHasOpenat2)
+    {
+        struct open_how how;
+        memset(&how, 0, sizeof(how));
+        how.flags = flags | O_CLOEXEC;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+        int fd = syscall(SYS_openat2, handle.mFd, relPath.c_str(), &how, sizeof(how));
+        if ((fd >= 0) || (errno != ENOSYS))
+            return fd;
+        LOG_DEBUG_SAF("%s: no openat2, checking resolved paths instead", __FUNCTION__);
+        mHasOpenat2 = false;
+    }
+    int fd = openat(handle.mFd, relPath.c_str(), flags | O_CLOEXEC);
+    if (fd < 0)
+        return fd;
+    char resolved[PATH_MAX];
+    std::string link = "/proc/self/fd/" + std::to_string(fd);
+    ssize_t len = readlink(link.c_str(), resolved, sizeof(resolved) - 1);
+    bool beneath = false;
+    if (len >= 0)
+        beneath = isUnder(std::string(resolved, len), handle.mRealPath);
+    else
+        beneath = (("/" + relPath + "/").find("/../") == std::string::npos);
+    if (!beneath)
+    {
+        close(fd);
+        errno = EXDEV;
+        return -1;
+    }
+    return fd;
+}
+
+int PathHandles::open(const std::string& root, const std::string& path, int flags)
+{
+    if (root.empty() || !isUnder(path, root))
+    {
+        errno = EXDEV;
+        return -1;
+    }
+    std::string relPath = path.substr(root.size());
+    relPath.erase(0, relPath.find_first_not_of('/'));
+    if (relPath.empty())
+        relPath = ".";
+    auto handle = getRoot(root, false);
+    if (!handle)
+        return -1;
+    int fd = openBeneath(*handle, relPath, flags);
+    if ((fd < 0) && ((errno == ENOENT) || (errno == ESTALE)))
+    {
+        int err = errno;
+        auto current = getRoot(root, true);
+        if (current && (current != handle))
+            return openBeneath(*current, relPath, flags);
+        errno = err;
+    }
+    return fd;
+}
+
+int PathHandles::openParent(const std::string& root, const std::string& path, std::string& leaf, bool create)
+{
+    size_t pos = path.find_last_of('/');
+    if (pos == std::string::npos)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    leaf = path.substr(pos + 1);
+    std::string parent = path.substr(0, pos);
+    if (leaf.empty() || (leaf == ".") || (leaf == ".."))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!create)
+        return open(root, parent.empty() ? "/" : parent, O_PATH | O_DIRECTORY);
+    return makeDirs(root, parent, 0777);
+}
+
+// Walks from root one component at a time, creating what is missing; no
+// component may be ".." or a symlink, so nothing is made outside root
+int PathHandles::makeDirs(const std::string& root, const std::string& dir, mode_t mode)
+{
+    if (!isUnder(dir, root))
+    {
+        errno = EXDEV;
+        return -1;
+    }
+    int fd = open(root, root, O_PATH | O_DIRECTORY);
+    size_t begin = root.size();
+    while ((fd >= 0) && (begin < dir.size()))
+    {
+        size_t end = dir.find('/', begin + 1);
+        if (end == std::string::npos)
+            end = dir.size();
+        std::string name = dir.substr(begin + 1, end - begin - 1);
+        begin = end;
+        if (name.empty() || (name == "."))
+            continue;
+        int next = -1;
+        if (name == "..")
+            errno = EXDEV;
+        else if ((mkdirat(fd, name.c_str(), mode) == 0) || (errno == EEXIST))
+            next = openat(fd, name.c_str(), O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        int err = errno;
+        close(fd);
+        errno = err;
+        fd = next;
+    }
+    return fd;
+}
+
+int PathHandles::makeDirs(const std::string& path, mode_t mode)
+{
+    std::string root = findRoot(path);
+    if (!root.empty())
+        return makeDirs(root, path, mode);
+    for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+    {
+        if ((mkdir(path.substr(0, pos).c_str(), mode) < 0) && (errno != EEXIST))
+            return -1;
+    }
+    if ((mkdir(path.c_str(), mode) < 0) && (errno != EEXIST))
+        return -1;
+    return ::open(path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+}
+
+int PathHandles::openParent(const std::string& path, std::string& leaf)
+{
+    std::string root = findRoot(path);
+    if (!root.empty())
+        return openParent(root, path, leaf);
+    size_t pos = path.find_last_of('/');
+    leaf = (pos == std::string::npos) ? "" : path.substr(pos + 1);
+    if (leaf.empty() || (leaf == ".") || (leaf == ".."))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return ::open((pos == 0) ? "/" : path.substr(0, pos).c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+}
+
+int PathHandles::open(const std::string& path, int flags)
+{
+    std::string root = findRoot(path);
+    if (root.empty())
+        return ::open(path.c_str(), flags | O_CLOEXEC);
+    return open(root, path, flags);
+}
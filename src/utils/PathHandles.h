@@ -0,0 +1,76 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#ifndef _PATH_HANDLES_H_
+#define _PATH_HANDLES_H_
+
+#include <sys/types.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/*
+ * Request paths resolved against an O_PATH handle of the storage root they
+ * live under (/media, /tmp or /home/<session>) instead of from "/" each time.
+ * Resolution uses openat2 with RESOLVE_BENEATH, so ".." or a symlink can
+ * never lead out of the root; the descriptor returned is then what the
+ * caller works on, leaving no gap between checking a path and using it.
+ * On kernels without openat2 the opened descriptor is checked against the
+ * root through /proc/self/fd instead.
+ */
+class PathHandles
+{
+public:
+    static PathHandles& getInstance();
+    // The root a request path belongs to, or "" when it is under none
+    static std::string findRoot(const std::string& path);
+    // Opens path beneath root; -1 with errno set on failure (EXDEV: escapes root)
+    int open(const std::string& root, const std::string& path, int flags);
+    // Beneath findRoot(path), or a plain open for paths under no root
+    int open(const std::string& path, int flags);
+    // Opens the directory holding path beneath root and gives the name of path
+    // in it, for *at calls made relative to that descriptor. With create the
+    // missing directories are made one component at a time, never through a
+    // symlink. -1 with errno set on failure.
+    int openParent(const std::string& root, const std::string& path, std::string& leaf, bool create = false);
+    // Beneath findRoot(path), or a plain open for paths under no root
+    int openParent(const std::string& path, std::string& leaf);
+    // Creates the directory path and its missing parents beneath root and
+    // opens it (O_PATH); -1 with errno set on failure
+    int makeDirs(const std::string& root, const std::string& path, mode_t mode);
+    // Beneath findRoot(path), or plain mkdir calls for paths under no root
+    int makeDirs(const std::string& path, mode_t mode = 0777);
+
+private:
+    struct RootHandle
+    {
+        int mFd;
+        dev_t mDev;
+        ino_t mIno;
+        std::string mRealPath;
+        ~RootHandle();
+    };
+
+    PathHandles() : mHasOpenat2(true) {}
+    PathHandles(const PathHandles&) = delete;
+    PathHandles& operator=(const PathHandles&) = delete;
+    std::shared_ptr<RootHandle> getRoot(const std::string& root, bool reopen);
+    int openBeneath(const RootHandle& handle, const std::string& relPath, int flags);
+
+    std::mutex mMutex;
+    std::map<std::string, std::shared_ptr<RootHandle>> mRoots;
+    std::atomic<bool> mHasOpenat2;
+};
+
+#endif /* _PATH_HANDLES_H_ */
@@ -0,0 +1,585 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include <linux/magic.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <set>
+#include "SAFLog.h"
+#include "SAFCopyEngine.h"
+#include "SAFUtilityOperation.h"
+#include "PathHandles.h"
+
+#define SAF_COPY_CHUNK_SIZE (8 * 1024 * 1024)
+#define SAF_COPY_BUFFER_SIZE (1024 * 1024)
+#define SAF_MAX_STREAMS_PER_DEVICE 4
+#define SAF_FAT32_MAX_FILE_SIZE 0xFFFFFFFFULL
+
+#ifndef EXFAT_SUPER_MAGIC
+#define EXFAT_SUPER_MAGIC 0x2011BAB0
+#endif
+#ifndef NTFS3_SUPER_MAGIC
+#define NTFS3_SUPER_MAGIC 0x7366746e
+#endif
+
+// FAT rewrites its allocation table for every sync and caps files at 4 GB;
+// exFAT wants large writes but cannot preallocate; NTFS goes through FUSE
+// (ntfs-3g), where every sync is a round trip to the daemon.
+static const TransferProfile sProfiles[] =
+{
+    { "default", SAF_COPY_CHUNK_SIZE, SAF_COPY_BUFFER_SIZE, 1, false, 0 },
+    { "vfat", 1024 * 1024, 1024 * 1024, 32, true, SAF_FAT32_MAX_FILE_SIZE },
+    { "exfat", 4 * 1024 * 1024, 4 * 1024 * 1024, 32, false, 0 },
+    { "ntfs", 1024 * 1024, 1024 * 1024, 16, false, 0 },
+    { "ext4", SAF_COPY_CHUNK_SIZE, 2 * 1024 * 1024, 1, true, 0 }
+};
+
+static const std::map<std::string, std::string> sProfileAliases =
+{
+    { "fat", "vfat" }, { "fat32", "vfat" }, { "msdos", "vfat" },
+    { "ntfs3", "ntfs" }, { "tntfs", "ntfs" }, { "fuseblk", "ntfs" },
+    { "ext2", "ext4" }, { "ext3", "ext4" }
+};
+
+static bool isUnsupported(int err)
+{
+    return ((err == EXDEV) || (err == EINVAL) || (err == ENOSYS)
+        || (err == EOPNOTSUPP) || (err == ENOTTY));
+}
+
+static int32_t getErrorStatus(int err)
+{
+    switch(err)
+    {
+        case EACCES:
+        case EPERM:
+        case EROFS:
+            return PERMISSION_DENIED;
+        case ENOENT:
+        case ENOTDIR:
+        case ELOOP:
+            return INVALID_PATH;
+        case EEXIST:
+            return FILE_ALREADY_EXISTS;
+        case EFBIG:
+            return FILE_TOO_LARGE;
+        default:
+            return UNKNOWN;
+    }
+}
+
+SAFCopyEngine& SAFCopyEngine::getInstance()
+{
+    static SAFCopyEngine obj;
+    return obj;
+}
+
+const TransferProfile& SAFCopyEngine::getProfile(const std::string& fsType)
+{
+    std::string lower = fsType;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    auto alias = sProfileAliases.find(lower);
+    const std::string& name = (alias == sProfileAliases.end()) ? lower : alias->second;
+    for (const auto& profile : sProfiles)
+    {
+        if (name == profile.mName)
+            return profile;
+    }
+    return sProfiles[0];
+}
+
+const TransferProfile& SAFCopyEngine::getPathProfile(const std::string& path)
+{
+    std::string current = path;
+    struct statfs fsStat;
+    while (statfs(current.c_str(), &fsStat) < 0)
+    {
+        size_t pos = current.find_last_of('/');
+        if ((errno != ENOENT) || (pos == std::string::npos) || (pos == 0))
+            return sProfiles[0];
+        current.erase(pos);
+    }
+    struct stat volStat;
+    if (stat(current.c_str(), &volStat) == 0)
+    {
+        SAFCopyEngine& engine = getInstance();
+        std::lock_guard<std::mutex> lock(engine.mMutex);
+        auto itr = engine.mVolumeTypes.find(volStat.st_dev);
+        if (itr != engine.mVolumeTypes.end())
+        {
+            const TransferProfile& profile = getProfile(itr->second.mFsType);
+            if (&profile != &sProfiles[0])
+                return profile;
+        }
+    }
+    // FUSE is left to the default: the superblock does not say what is behind it
+    switch ((unsigned long)fsStat.f_type)
+    {
+        case MSDOS_SUPER_MAGIC:
+            return getProfile("vfat");
+        case EXFAT_SUPER_MAGIC:
+            return getProfile("exfat");
+        case NTFS3_SUPER_MAGIC:
+            return getProfile("ntfs");
+        case EXT4_SUPER_MAGIC:
+            return getProfile("ext4");
+        default:
+            return sProfiles[0];
+    }
+}
+
+void SAFCopyEngine::setVolumeTypes(const std::map<std::string, std::string>& types)
+{
+    std::map<dev_t, Volume> volumeTypes;
+    for (const auto& entry : types)
+    {
+        struct stat st;
+        if (stat(entry.first.c_str(), &st) == 0)
+            volumeTypes[st.st_dev] = { entry.first, entry.second };
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    mVolumeTypes.swap(volumeTypes);
+    // volumeTypes now holds the old set; any device not registered the same
+    // way in both may be a different stick behind a reused number
+    std::set<dev_t> changed;
+    for (const auto& entry : volumeTypes)
+    {
+        auto itr = mVolumeTypes.find(entry.first);
+        if ((itr == mVolumeTypes.end()) || (itr->second.mMountPath != entry.second.mMountPath)
+            || (itr->second.mFsType != entry.second.mFsType))
+            changed.insert(entry.first);
+    }
+    for (const auto& entry : mVolumeTypes)
+    {
+        if (volumeTypes.find(entry.first) == volumeTypes.end())
+            changed.insert(entry.first);
+    }
+    for (dev_t dev : changed)
+        forgetDevice(dev);
+}
+
+// Called with mMutex held
+void SAFCopyEngine::forgetDevice(dev_t dev)
+{
+    mDevices.erase(dev);
+    for (auto itr = mStrategies.begin(); itr != mStrategies.end();)
+    {
+        if ((itr->first.first == dev) || (itr->first.second == dev))
+            itr = mStrategies.erase(itr);
+        else
+            ++itr;
+    }
+}
+
+CopyStrategy SAFCopyEngine::getStrategy(dev_t srcDev, dev_t destDev)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto itr = mStrategies.find(std::make_pair(srcDev, destDev));
+    if (itr == mStrategies.end())
+        return CopyStrategy::REFLINK;
+    return itr->second;
+}
+
+SAFCopyEngine::DeviceInfo SAFCopyEngine::getDeviceInfo(dev_t dev)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto itr = mDevices.find(dev);
+        if (itr != mDevices.end())
+            return itr->second;
+    }
+    DeviceInfo info;
+    // Spinning disks (USB HDDs) only lose throughput to parallel seeks
+    info.mStreamLimit = SAF_MAX_STREAMS_PER_DEVICE;
+    info.mRemovable = false;
+    std::string sysPath = "/sys/dev/block/" + std::to_string(major(dev)) + ":" + std::to_string(minor(dev));
+    for (const char *queue : { "/queue/rotational", "/../queue/rotational" })
+    {
+        std::ifstream file(sysPath + queue);
+        int rotational = 0;
+        if (file >> rotational)
+        {
+            if (rotational)
+                info.mStreamLimit = 1;
+            break;
+        }
+    }
+    // USB disks often do not claim to be removable, so their bus counts too
+    char link[PATH_MAX];
+    ssize_t len = readlink(sysPath.c_str(), link, sizeof(link) - 1);
+    if ((len > 0) && (std::string(link, len).find("/usb") != std::string::npos))
+        info.mRemovable = true;
+    for (const char *removable : { "/removable", "/../removable" })
+    {
+        std::ifstream file(sysPath + removable);
+        int value = 0;
+        if (file >> value)
+        {
+            if (value)
+                info.mRemovable = true;
+            break;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDevices[dev] = info;
+    return info;
+}
+
+size_t SAFCopyEngine::getDeviceLimit(dev_t dev)
+{
+    return getDeviceInfo(dev).mStreamLimit;
+}
+
+void SAFCopyEngine::acquireDevices(dev_t srcDev, dev_t destDev)
+{
+    size_t srcLimit = getDeviceLimit(srcDev);
+    size_t destLimit = getDeviceLimit(destDev);
+    // Both devices are taken together, so a waiting stream never holds a slot
+    std::unique_lock<std::mutex> lock(mMutex);
+    mStreamCondVar.wait(lock, [&] {
+        return ((mActiveStreams[srcDev] < srcLimit) && (mActiveStreams[destDev] < destLimit));
+    });
+    ++mActiveStreams[srcDev];
+    if (destDev != srcDev)
+        ++mActiveStreams[destDev];
+}
+
+void SAFCopyEngine::releaseDevices(dev_t srcDev, dev_t destDev)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        --mActiveStreams[srcDev];
+        if (destDev != srcDev)
+            --mActiveStreams[destDev];
+    }
+    mStreamCondVar.notify_all();
+}
+
+void SAFCopyEngine::demote(dev_t srcDev, dev_t destDev, CopyStrategy failed)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    CopyStrategy& strategy = mStrategies.emplace(std::make_pair(srcDev, destDev), CopyStrategy::REFLINK).first->second;
+    // Another copy may already have demoted this pair further
+    if (strategy != failed)
+        return;
+    strategy = static_cast<CopyStrategy>(static_cast<int>(failed) + 1);
+    LOG_DEBUG_SAF("%s: devices %lu -> %lu now use strategy %d", __FUNCTION__,
+        (unsigned long)srcDev, (unsigned long)destDev, static_cast<int>(strategy));
+}
+
+void SAFCopyEngine::beginTransfer(dev_t dev)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mWriteBack[dev].mTransfers;
+}
+
+void SAFCopyEngine::endTransfer(dev_t dev)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto itr = mWriteBack.find(dev);
+    if (itr == mWriteBack.end())
+        return;
+    --itr->second.mTransfers;
+    if ((itr->second.mTransfers == 0) && (itr->second.mDirtyBytes == 0))
+        mWriteBack.erase(itr);
+}
+
+void SAFCopyEngine::getWriteBack(dev_t dev, uint64_t& dirtyBytes, size_t& transfers)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto itr = mWriteBack.find(dev);
+    dirtyBytes = (itr == mWriteBack.end()) ? 0 : itr->second.mDirtyBytes;
+    transfers = (itr == mWriteBack.end()) ? 0 : itr->second.mTransfers;
+}
+
+int32_t SAFCopyEngine::flushVolume(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return getErrorStatus(errno);
+    int32_t status = SUCCESS;
+    if (syncfs(fd) < 0)
+        status = getErrorStatus(errno);
+    close(fd);
+    return status;
+}
+
+void SAFCopyEngine::addDirty(dev_t dev, int64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    WriteBack& writeBack = mWriteBack[dev];
+    writeBack.mDirtyBytes += bytes;
+    if ((writeBack.mTransfers == 0) && (writeBack.mDirtyBytes == 0))
+        mWriteBack.erase(dev);
+}
+
+void SAFCopyEngine::flushBehind(int outFd, dev_t dev, off_t offset, off_t length, FlushWindow& window)
+{
+    if (!window.mEnabled)
+        return;
+    addDirty(dev, length);
+    // Start writing this chunk back, then wait for the one before it; the
+    // copy keeps filling the next chunk while the device drains this one
+    sync_file_range(outFd, offset, length, SYNC_FILE_RANGE_WRITE);
+    if (window.mLength > 0)
+    {
+        sync_file_range(outFd, window.mOffset, window.mLength,
+            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        addDirty(dev, -window.mLength);
+    }
+    window.mOffset = offset;
+    window.mLength = length;
+}
+
+void SAFCopyEngine::flushFile(int outFd, dev_t dev, const TransferProfile& profile, FlushWindow& window)
+{
+    if (!window.mEnabled)
+        return;
+    if (window.mLength > 0)
+    {
+        sync_file_range(outFd, window.mOffset, window.mLength,
+            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        addDirty(dev, -window.mLength);
+        window.mLength = 0;
+    }
+    if (profile.mSyncInterval == 1)
+    {
+        fdatasync(outFd);
+        return;
+    }
+    if (profile.mSyncInterval == 0)
+        return;
+    // Metadata is written back for a batch of files at once
+    bool sync = false;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        WriteBack& writeBack = mWriteBack[dev];
+        if (++writeBack.mUnsyncedFiles >= profile.mSyncInterval)
+        {
+            writeBack.mUnsyncedFiles = 0;
+            sync = true;
+        }
+    }
+    if (sync)
+        syncfs(outFd);
+}
+
+int32_t SAFCopyEngine::copyRange(int inFd, int outFd, off_t offset, off_t length, CopyStrategy& strategy,
+    dev_t srcDev, dev_t destDev, const TransferProfile& profile, FlushWindow& window,
+    ProgressCallback& progressCb)
+{
+    std::unique_ptr<char[]> buffer;
+    off_t end = offset + length;
+    while (offset < end)
+    {
+        size_t chunk = (size_t)std::min<off_t>(end - offset, profile.mChunkSize);
+        ssize_t copied = -1;
+        if (strategy == CopyStrategy::COPY_FILE_RANGE)
+        {
+            loff_t inOffset = offset;
+            loff_t outOffset = offset;
+            copied = copy_file_range(inFd, &inOffset, outFd, &outOffset, chunk, 0);
+            if ((copied < 0) && isUnsupported(errno))
+            {
+                demote(srcDev, destDev, strategy);
+                strategy = CopyStrategy::SENDFILE;
+                continue;
+            }
+        }
+        else if (strategy == CopyStrategy::SENDFILE)
+        {
+            off_t inOffset = offset;
+            if (lseek(outFd, offset, SEEK_SET) < 0)
+                return getErrorStatus(errno);
+            copied = sendfile(outFd, inFd, &inOffset, chunk);
+            if ((copied < 0) && isUnsupported(errno))
+            {
+                demote(srcDev, destDev, strategy);
+                strategy = CopyStrategy::READ_WRITE;
+                continue;
+            }
+        }
+        else
+        {
+            if (!buffer)
+                buffer.reset(new char[profile.mBufferSize]);
+            chunk = std::min<size_t>(chunk, profile.mBufferSize);
+            copied = pread(inFd, buffer.get(), chunk, offset);
+            for (ssize_t written = 0; (copied > 0) && (written < copied);)
+            {
+                ssize_t ret = pwrite(outFd, buffer.get() + written, copied - written, offset + written);
+                if (ret < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    return getErrorStatus(errno);
+                }
+                written += ret;
+            }
+        }
+        if (copied < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return getErrorStatus(errno);
+        }
+        // Source was truncated while we were copying it
+        if (copied == 0)
+            break;
+        flushBehind(outFd, destDev, offset, copied, window);
+        offset += copied;
+        if (!progressCb(copied))
+            return OPERATION_CANCELLED;
+    }
+    return SUCCESS;
+}
+
+int32_t SAFCopyEngine::copyFile(const std::string& srcPath, const std::string& destPath,
+    bool overwrite, ProgressCallback progressCb)
+{
+    // Both ends are resolved beneath their roots once, and every later call
+    // works on those descriptors, so a symlink swapped in meanwhile is not followed
+    int inFd = PathHandles::getInstance().open(srcPath, O_RDONLY);
+    if (inFd < 0)
+        return ((errno == ENOENT) || (errno == EXDEV)) ? INVALID_SOURCE_PATH : getErrorStatus(errno);
+    struct stat srcStat;
+    if ((fstat(inFd, &srcStat) < 0) || !S_ISREG(srcStat.st_mode))
+    {
+        close(inFd);
+        return INVALID_SOURCE_PATH;
+    }
+    std::string leaf;
+    int dirFd = PathHandles::getInstance().openParent(destPath, leaf);
+    if (dirFd < 0)
+    {
+        int32_t status = (errno == EXDEV) ? INVALID_PATH : getErrorStatus(errno);
+        close(inFd);
+        return status;
+    }
+    struct stat destStat;
+    if (overwrite && (fstatat(dirFd, leaf.c_str(), &destStat, AT_SYMLINK_NOFOLLOW) == 0)
+        && (destStat.st_dev == srcStat.st_dev) && (destStat.st_ino == srcStat.st_ino))
+    {
+        // Truncating the destination would destroy the source
+        close(dirFd);
+        close(inFd);
+        return FILE_ALREADY_EXISTS;
+    }
+    // Checked before the destination is created, so nothing is left half written
+    const TransferProfile& profile = getPathProfile(destPath.substr(0, destPath.find_last_of('/')));
+    if (profile.mMaxFileSize && ((uint64_t)srcStat.st_size > profile.mMaxFileSize))
+    {
+        close(dirFd);
+        close(inFd);
+        return FILE_TOO_LARGE;
+    }
+    int flags = O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC | (overwrite ? O_TRUNC : O_EXCL);
+    int outFd = openat(dirFd, leaf.c_str(), flags, srcStat.st_mode & 07777);
+    if (outFd < 0)
+    {
+        int32_t status = getErrorStatus(errno);
+        close(dirFd);
+        close(inFd);
+        return status;
+    }
+    fstat(outFd, &destStat);
+
+    int32_t status = SUCCESS;
+    bool cloned = false;
+    FlushWindow window;
+    window.mEnabled = getDeviceInfo(destStat.st_dev).mRemovable;
+    CopyStrategy strategy = getStrategy(srcStat.st_dev, destStat.st_dev);
+    if (strategy == CopyStrategy::REFLINK)
+    {
+#ifdef FICLONE
+        if (ioctl(outFd, FICLONE, inFd) == 0)
+        {
+            cloned = true;
+            progressCb(srcStat.st_size);
+        }
+        else if (isUnsupported(errno))
+        {
+            demote(srcStat.st_dev, destStat.st_dev, strategy);
+        }
+#else
+        demote(srcStat.st_dev, destStat.st_dev, strategy);
+#endif
+        strategy = CopyStrategy::COPY_FILE_RANGE;
+    }
+
+    off_t size = srcStat.st_size;
+    if (!cloned && (size > 0))
+    {
+        if (((off_t)srcStat.st_blocks * 512) >= size)
+        {
+            // One contiguous reservation instead of growing cluster by cluster;
+            // running out of space fails here rather than deep into the file
+            if (profile.mPreallocate && (fallocate(outFd, FALLOC_FL_KEEP_SIZE, 0, size) < 0) && (errno == ENOSPC))
+                status = getErrorStatus(errno);
+            if (status == SUCCESS)
+                status = copyRange(inFd, outFd, 0, size, strategy, srcStat.st_dev, destStat.st_dev,
+                    profile, window, progressCb);
+        }
+        else
+        {
+            // Sparse source: copy only the data extents and leave the holes
+            off_t offset = 0;
+            while ((status == SUCCESS) && (offset < size))
+            {
+                off_t data = lseek(inFd, offset, SEEK_DATA);
+                if (data < 0)
+                {
+                    // ENXIO means only a hole is left; anything else means no
+                    // SEEK_DATA support, so copy the rest densely
+                    if (errno != ENXIO)
+                        status = copyRange(inFd, outFd, offset, size - offset,
+                            strategy, srcStat.st_dev, destStat.st_dev, profile, window, progressCb);
+                    else
+                        progressCb(size - offset);
+                    offset = size;
+                    break;
+                }
+                off_t hole = lseek(inFd, data, SEEK_HOLE);
+                if (hole < 0)
+                    hole = size;
+                if (data > offset)
+                    progressCb(data - offset);
+                status = copyRange(inFd, outFd, data, hole - data,
+                    strategy, srcStat.st_dev, destStat.st_dev, profile, window, progressCb);
+                offset = hole;
+            }
+            if ((status == SUCCESS) && (ftruncate(outFd, size) < 0))
+                status = getErrorStatus(errno);
+        }
+    }
+    if (status == SUCCESS)
+        fchmod(outFd, srcStat.st_mode & 07777);
+    flushFile(outFd, destStat.st_dev, profile, window);
+    close(inFd);
+    if ((close(outFd) < 0) && (status == SUCCESS))
+        status = getErrorStatus(errno);
+    if (status != SUCCESS)
+        unlinkat(dirFd, leaf.c_str(), 0);
+    close(dirFd);
+    return status;
+}
@@ -0,0 +1,135 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#ifndef _SAF_COPY_ENGINE_H_
+#define _SAF_COPY_ENGINE_H_
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+enum class CopyStrategy
+{
+    REFLINK, COPY_FILE_RANGE, SENDFILE, READ_WRITE
+};
+
+// How writes are shaped for one kind of destination filesystem
+struct TransferProfile
+{
+    const char *mName;
+    size_t mChunkSize;       // bytes per copy call, and the flush-behind window
+    size_t mBufferSize;      // bytes per read/write when the kernel cannot copy
+    size_t mSyncInterval;    // files between syncs on removable media; 1 fdatasyncs each, 0 leaves it to eject
+    bool mPreallocate;       // reserve the file's blocks up front with fallocate
+    uint64_t mMaxFileSize;   // 0 when the filesystem has no practical limit
+};
+
+/*
+ * Copies regular files with the cheapest data path the kernel offers.
+ * Every source/destination device pair starts at REFLINK and is demoted
+ * (copy_file_range, sendfile, read/write) the first time a strategy is
+ * refused; the result is remembered for the next file on that pair.
+ * Sparse sources are copied extent by extent, keeping their holes.
+ * It also bounds how many copy streams may hit one device at a time.
+ * Writes to removable devices are flushed behind the copy, one chunk back,
+ * and every finished file is fdatasync'ed, so the data still dirty on a
+ * stick stays small and eject has little left to wait for.
+ * Chunk sizes, sync cadence, preallocation and the file size limit come
+ * from the TransferProfile of the destination filesystem.
+ */
+class SAFCopyEngine
+{
+public:
+    // Called with the bytes written since the last call; returning false aborts the copy
+    typedef std::function<bool(uint64_t)> ProgressCallback;
+
+    static SAFCopyEngine& getInstance();
+    // By filesystem type name as PDM or /proc/mounts give it ("vfat", "exfat", ...)
+    static const TransferProfile& getProfile(const std::string& fsType);
+    // For the filesystem holding path, or its nearest existing parent: by the
+    // type registered for that volume, else by what statfs reports
+    static const TransferProfile& getPathProfile(const std::string& path);
+    // Filesystem types by mount path, as the storage registry reports them;
+    // replaces the previously registered set. What was learnt about a device
+    // number whose volume went away or changed is forgotten, as the number
+    // may come back with another stick.
+    void setVolumeTypes(const std::map<std::string, std::string>& types);
+    int32_t copyFile(const std::string& srcPath, const std::string& destPath,
+        bool overwrite, ProgressCallback progressCb);
+    CopyStrategy getStrategy(dev_t srcDev, dev_t destDev);
+    size_t getDeviceLimit(dev_t dev);
+    void acquireDevices(dev_t srcDev, dev_t destDev);
+    void releaseDevices(dev_t srcDev, dev_t destDev);
+    // Brackets a whole copy or move from or into dev, or a remove or purge
+    // on it, for eject to see
+    void beginTransfer(dev_t dev);
+    void endTransfer(dev_t dev);
+    // Bytes written to dev and not yet known to be on the media, and the transfers writing to it
+    void getWriteBack(dev_t dev, uint64_t& dirtyBytes, size_t& transfers);
+    // Writes back everything dirty on the filesystem mounted at path
+    int32_t flushVolume(const std::string& path);
+
+private:
+    struct DeviceInfo
+    {
+        size_t mStreamLimit;
+        bool mRemovable;
+    };
+
+    struct Volume
+    {
+        std::string mMountPath;
+        std::string mFsType;
+    };
+
+    struct WriteBack
+    {
+        uint64_t mDirtyBytes = 0;
+        size_t mTransfers = 0;
+        size_t mUnsyncedFiles = 0;
+    };
+
+    // The chunk written last, whose writeback was started but not waited for
+    struct FlushWindow
+    {
+        bool mEnabled = false;
+        off_t mOffset = 0;
+        off_t mLength = 0;
+    };
+
+    SAFCopyEngine() {}
+    SAFCopyEngine(const SAFCopyEngine&) = delete;
+    SAFCopyEngine& operator=(const SAFCopyEngine&) = delete;
+    DeviceInfo getDeviceInfo(dev_t dev);
+    void demote(dev_t srcDev, dev_t destDev, CopyStrategy failed);
+    void forgetDevice(dev_t dev);
+    void addDirty(dev_t dev, int64_t bytes);
+    void flushBehind(int outFd, dev_t dev, off_t offset, off_t length, FlushWindow& window);
+    void flushFile(int outFd, dev_t dev, const TransferProfile& profile, FlushWindow& window);
+    int32_t copyRange(int inFd, int outFd, off_t offset, off_t length, CopyStrategy& strategy,
+        dev_t srcDev, dev_t destDev, const TransferProfile& profile, FlushWindow& window,
+        ProgressCallback& progressCb);
+
+    std::mutex mMutex;
+    std::map<std::pair<dev_t, dev_t>, CopyStrategy> mStrategies;
+    std::condition_variable mStreamCondVar;
+    std::map<dev_t, DeviceInfo> mDevices;
+    std::map<dev_t, size_t> mActiveStreams;
+    std::map<dev_t, WriteBack> mWriteBack;
+    std::map<dev_t, Volume> mVolumeTypes;
+};
+
+#endif /* _SAF_COPY_ENGINE_H_ */
@@ -10,6 +10,19 @@
  *
  * LICENSE@@@ */
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <condition_variable>
 #include <functional>
 #include <future>
 #include <fstream>
@@ -19,40 +32,117 @@
 #include "SAFLog.h"
 #include <chrono>
 #include <iomanip>
+#include <sstream>
 #include <fstream>
 #include "SAFUtilityOperation.h"
+#include "ListingCache.h"
+#include "TransferManager.h"
+#include "SAFCopyEngine.h"
+#include "SAFWorkerPool.h"
+#include "PathHandles.h"
+#include "SizeIndex.h"
 
 namespace fs = std::filesystem;
 
-bool validateInternalPath(std::string& path)
+#define SAF_COPY_SMALL_FILE_SIZE (1024 * 1024)
+#define SAF_COPY_BATCH_BYTES (8 * 1024 * 1024)
+#define SAF_COPY_BATCH_FILES 64
+#define SAF_DIR_SIZE_TTL_SEC 30
+#define SAF_DIR_SIZE_MAX_ENTRIES 1024
+#define SAF_VOLUME_INFO_TTL_MS 3000
+#define SAF_LIST_SNAPSHOT_TTL_SEC 60
+#define SAF_LIST_SNAPSHOT_MAX_COUNT 32
+#define SAF_LIST_SNAPSHOT_MAX_ENTRIES 200000
+#define SAF_PURGE_DIR_NAME ".saf-purge"
+#define SAF_TRASH_DIR_NAME ".saf-trash"
+#define SAF_TRASH_RETENTION_SEC (30 * 24 * 60 * 60)
+#define SAF_TRASH_MIN_FREE_PERCENT 10
+#define SAF_IOPRIO_WHO_PROCESS 1
+#define SAF_IOPRIO_CLASS_IDLE 3
+#define SAF_IOPRIO_CLASS_SHIFT 13
+
+// Lexical checks only; whether the path exists is up to whoever opens it
+static bool isRequestPath(const std::string& path)
 {
-    bool retVal = true;
-    try
+    return !path.empty() && (path[0] == '/') && (path[path.size() - 1] != '/');
+}
+
+// Resolves path once beneath its storage root to see that it is there
+static bool existsBeneath(const std::string& root, const std::string& path)
+{
+    PathHandles& handles = PathHandles::getInstance();
+    int fd = root.empty() ? handles.open(path, O_PATH) : handles.open(root, path, O_PATH);
+    if (fd < 0)
     {
-        if (path.empty() || (path.find("/") != 0)
-            || (path[path.size() - 1] == '/') || !fs::exists(path))
-        {
-            LOG_DEBUG_SAF("%s: invalid path [%s]", __FUNCTION__, path.c_str());
-            retVal = false;
-        }
+        LOG_DEBUG_SAF("%s: %s: %s", __FUNCTION__, path.c_str(), strerror(errno));
+        return false;
     }
-    catch(fs::filesystem_error& e)
+    close(fd);
+    return true;
+}
+
+// The calls below that change the tree act relative to the parent directory
+// resolved beneath the path's root, so a symlink swapped into the path after
+// validation is never followed. -1 with errno set on failure.
+static int unlinkBeneath(const std::string& path, int flags)
+{
+    std::string leaf;
+    int dirFd = PathHandles::getInstance().openParent(path, leaf);
+    if (dirFd < 0)
+        return -1;
+    int ret = unlinkat(dirFd, leaf.c_str(), flags);
+    int err = errno;
+    close(dirFd);
+    errno = err;
+    return ret;
+}
+
+static int renameBeneath(const std::string& from, const std::string& to, unsigned int flags)
+{
+    PathHandles& handles = PathHandles::getInstance();
+    std::string fromLeaf;
+    std::string toLeaf;
+    int fromFd = handles.openParent(from, fromLeaf);
+    if (fromFd < 0)
+        return -1;
+    int toFd = handles.openParent(to, toLeaf);
+    int ret = (toFd < 0) ? -1 : renameat2(fromFd, fromLeaf.c_str(), toFd, toLeaf.c_str(), flags);
+    int err = errno;
+    close(fromFd);
+    if (toFd >= 0)
+        close(toFd);
+    errno = err;
+    return ret;
+}
+
+// Stands in for fs::create_directories, and fails the same way
+static void createDirsBeneath(const std::string& path)
+{
+    int fd = PathHandles::getInstance().makeDirs(path);
+    if (fd < 0)
+        throw fs::filesystem_error("create_directories", path, std::error_code(errno, std::generic_category()));
+    close(fd);
+}
+
+bool validateInternalPath(std::string& path)
+{
+    if (!isRequestPath(path) || !existsBeneath("", path))
     {
-        LOG_DEBUG_SAF("%s: %s", __FUNCTION__, e.what());
-        retVal = false;
+        LOG_DEBUG_SAF("%s: invalid path [%s]", __FUNCTION__, path.c_str());
+        return false;
     }
-    return retVal;
+    return true;
 }
+
 bool SAFUtilityOperation::validateInternalPath(std::string& path, std::string& sessionId)
 {
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
-    if ((path.find("/media") == 0) || (path.find("/tmp") == 0) || (path.find("/home/"+sessionId) == 0))
-    {
-        std::error_code ec;
-        if(fs::exists(path, ec))
-            return true;
-        LOG_DEBUG_SAF("%s, errorCode: %d", __FUNCTION__, ec.value());
-    }
+    std::string root = PathHandles::findRoot(path);
+    // Without a session every home is reachable, as on single-user targets
+    if (sessionId.empty() && (path.compare(0, 6, "/home/") == 0))
+        root = "/home";
+    if ((root == "/media") || (root == "/tmp") || (root == "/home/" + sessionId) || (root == "/home"))
+        return existsBeneath(root, path);
     return false;
 }
 
@@ -60,6 +150,7 @@ bool SAFUtilityOperation::validateSambaPath(std::string& path,std::string& drive
 {
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
     std::error_code ec;
+    std::lock_guard<std::mutex> lock(mDriveMapMutex);
     if((mSambaDrivePathMap.find(driveId) != mSambaDrivePathMap.end()) && (path.find(mSambaDrivePathMap[driveId]) == 0)
         && fs::exists(path, ec))
         return true;
@@ -72,6 +163,7 @@ void SAFUtilityOperation::setDriveDetails(const std::string& type, std::map<std:
     LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
     if(type == "SAMBA")
     {
+        std::lock_guard<std::mutex> lock(mDriveMapMutex);
         mSambaDrivePathMap.clear();
         for(auto & entry : inputMap)
             mSambaDrivePathMap[entry.first] = entry.second;
@@ -134,82 +226,126 @@ bool SAFUtilityOperation::validateInterProviderOperation(std::shared_ptr<Request
     return result;
 }
 
+// Resolves "chown <user>:" the way the shell did: the user's uid and login gid
+static bool getSessionOwner(const std::string& sessionId, uid_t& uid, gid_t& gid)
+{
+    long size = sysconf(_SC_GETPW_R_SIZE_MAX);
+    std::vector<char> buffer((size > 0) ? size : 16384);
+    struct passwd pwd;
+    struct passwd *result = NULL;
+    if ((getpwnam_r(sessionId.c_str(), &pwd, buffer.data(), buffer.size(), &result) != 0) || !result)
+        return false;
+    uid = pwd.pw_uid;
+    gid = pwd.pw_gid;
+    return true;
+}
+
+// Gives name (inside dirFd) to the session user with mode 700, without a shell
+static void setSessionPerm(int dirFd, const char *name, const std::string& sessionId)
+{
+    uid_t uid;
+    gid_t gid;
+    if (!getSessionOwner(sessionId, uid, gid))
+    {
+        LOG_DEBUG_SAF("%s: no user %s, owner of %s unchanged", __FUNCTION__, sessionId.c_str(), name);
+    }
+    else if (fchownat(dirFd, name, uid, gid, AT_SYMLINK_NOFOLLOW) < 0)
+    {
+        LOG_DEBUG_SAF("%s: chown %s failed: %s", __FUNCTION__, name, strerror(errno));
+    }
+    if (fchmodat(dirFd, name, 0700, 0) < 0)
+        LOG_DEBUG_SAF("%s: chmod %s failed: %s", __FUNCTION__, name, strerror(errno));
+}
+
+// mkdir -p: one mkdirat per component, each relative to its parent's fd.
+// Returns an O_PATH fd of the directory, or -1 with errno set.
+static int makeDirectories(const std::string& path, mode_t mode)
+{
+    int dirFd = open("/", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    size_t begin = 0;
+    while ((dirFd >= 0) && (begin < path.size()))
+    {
+        size_t end = path.find('/', begin);
+        if (end == std::string::npos)
+            end = path.size();
+        std::string name = path.substr(begin, end - begin);
+        begin = end + 1;
+        if (name.empty())
+            continue;
+        int next = -1;
+        if ((mkdirat(dirFd, name.c_str(), mode) == 0) || (errno == EEXIST))
+            next = openat(dirFd, name.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        int err = errno;
+        close(dirFd);
+        errno = err;
+        dirFd = next;
+    }
+    return dirFd;
+}
+
+bool SAFUtilityOperation::createDirectories(const std::string& path)
+{
+    int dirFd = makeDirectories(path, 0777);
+    if (dirFd < 0)
+    {
+        LOG_DEBUG_SAF("%s: %s: %s", __FUNCTION__, path.c_str(), strerror(errno));
+        return false;
+    }
+    close(dirFd);
+    return true;
+}
+
 std::string SAFUtilityOperation::getInternalPath(std::string sessionId)
 {
-    LOG_DEBUG_SAF("Exiting function %s", __FUNCTION__);
-    std::string path = "/safInternal";
-    if (sessionId.find("root") != std::string::npos)
-        path = "/home/" + sessionId + path;
-    else
-        path = "/home/" + sessionId + "/rootfs" + path;
-    LOG_DEBUG_SAF("%s: file %s initiaized", __FUNCTION__, path.c_str());
-    std::error_code ec;
-    if (!fs::exists(path, ec))
+    LOG_DEBUG_SAF("Entering function %s", __FUNCTION__);
     {
-        LOG_DEBUG_SAF("%s: Before creating file: %s", __FUNCTION__, path.c_str());
-        try {
-            fs::create_directories(path);
-        }
-        catch(fs::filesystem_error& e) {
-            LOG_DEBUG_SAF("%s: Error in creating dir : %s", __FUNCTION__, e.what());
-            path.clear();
-            return path;
-        }
-        std::string cmd = "chown " + sessionId + ": " + path;
-        LOG_DEBUG_SAF("%s: Before exe cmd: %s", __FUNCTION__, cmd.c_str());
-        FILE *fp = popen(cmd.data(), "r");
-        if (fp != NULL){
-            LOG_DEBUG_SAF("%s: cmd: %s Success", __FUNCTION__, cmd.c_str());
-            pclose(fp);
-            fp = NULL;
-        }
-        else
-            LOG_DEBUG_SAF("%s: cmd: %s Fail", __FUNCTION__, cmd.c_str());
-        cmd = "chmod 700 " + path;
-        LOG_DEBUG_SAF("%s: Before exe cmd: %s", __FUNCTION__, cmd.c_str());
-        fp = popen(cmd.data(), "r");
-        if (fp != NULL)
-        {
-            LOG_DEBUG_SAF("%s: cmd: %s Success", __FUNCTION__, cmd.c_str());
-            pclose(fp);
-            fp = NULL;
-        }
-        else
-            LOG_DEBUG_SAF("%s: cmd: %s Fail", __FUNCTION__, cmd.c_str());
+        // Resolved once per session; afterwards only checked to still exist
+        std::lock_guard<std::mutex> lock(mInternalPathMutex);
+        auto itr = mInternalPaths.find(sessionId);
+        if ((itr != mInternalPaths.end()) && (access(itr->second.c_str(), F_OK) == 0))
+            return itr->second;
     }
-    else
-        LOG_DEBUG_SAF("%s: file: %s already exists", __FUNCTION__, path.c_str());
-    LOG_DEBUG_SAF("%s, errorCode: %d", __FUNCTION__, ec.value());
+    std::string home = "/home/" + sessionId;
+    if (sessionId.find("root") == std::string::npos)
+        home += "/rootfs";
+    std::string path = home + "/safInternal";
+    int homeFd = makeDirectories(home, 0777);
+    if (homeFd < 0)
+    {
+        LOG_DEBUG_SAF("%s: Error in creating dir %s: %s", __FUNCTION__, home.c_str(), strerror(errno));
+        return std::string();
+    }
+    if (mkdirat(homeFd, "safInternal", 0700) == 0)
+    {
+        LOG_DEBUG_SAF("%s: created %s", __FUNCTION__, path.c_str());
+        setSessionPerm(homeFd, "safInternal", sessionId);
+    }
+    else if (errno != EEXIST)
+    {
+        LOG_DEBUG_SAF("%s: Error in creating dir %s: %s", __FUNCTION__, path.c_str(), strerror(errno));
+        close(homeFd);
+        return std::string();
+    }
+    close(homeFd);
+    {
+        std::lock_guard<std::mutex> lock(mInternalPathMutex);
+        mInternalPaths[sessionId] = path;
+    }
+    SizeIndex::getInstance().addRoot(path);
     return path;
 }
 
 void SAFUtilityOperation::setPathPerm(std::string path, std::string sessionId)
 {
-    std::error_code ec;
-    if (!fs::exists(path, ec))
+    fs::path target(path);
+    int parentFd = open(target.parent_path().c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (parentFd < 0)
     {
-        LOG_DEBUG_SAF("%s, errorCode: %d", __FUNCTION__, ec.value());
+        LOG_DEBUG_SAF("%s: %s: %s", __FUNCTION__, path.c_str(), strerror(errno));
         return;
     }
-    std::string cmd = "chown " + sessionId + ": " + path;
-    FILE *fp = popen(cmd.data(), "r");
-    if (fp != NULL){
-        LOG_DEBUG_SAF("%s: cmd: %s Success", __FUNCTION__, cmd.c_str());
-        pclose(fp);
-        fp = NULL;
-    }
-    else
-        LOG_DEBUG_SAF("%s: cmd: %s Fail", __FUNCTION__, cmd.c_str());
-    cmd = "chmod 700 " + path;
-    fp = popen(cmd.data(), "r");
-    if (fp != NULL)
-    {
-        LOG_DEBUG_SAF("%s: cmd: %s Success", __FUNCTION__, cmd.c_str());
-        pclose(fp);
-        fp = NULL;
-    }
-    else
-        LOG_DEBUG_SAF("%s: cmd: %s Fail", __FUNCTION__, cmd.c_str());
+    setSessionPerm(parentFd, target.filename().c_str(), sessionId);
+    close(parentFd);
 }
 
 int getInternalErrorCode(int errorCode)
@@ -222,6 +358,9 @@ int getInternalErrorCode(int errorCode)
         {InternalOperErrors::INVALID_DEST_PATH, SAFErrors::INVALID_DEST_PATH},
         {InternalOperErrors::FILE_ALREADY_EXISTS, SAFErrors::FILE_ALREADY_EXISTS},
         {InternalOperErrors::PERMISSION_DENIED,     SAFErrors::PERMISSION_DENIED},
+        {InternalOperErrors::OPERATION_CANCELLED, SAFErrors::OPERATION_CANCELLED},
+        {InternalOperErrors::INVALID_CURSOR, SAFErrors::INVALID_CURSOR},
+        {InternalOperErrors::FILE_TOO_LARGE, SAFErrors::FILE_TOO_LARGE},
         {InternalOperErrors::SUCCESS, SAFErrors::NO_ERROR}
     };
     int retCode = SAFErrors::UNKNOWN_ERROR;
@@ -230,183 +369,550 @@ int getInternalErrorCode(int errorCode)
     return retCode;
 }
 
-FolderContent::FolderContent(std::string absPath) : mPath(std::move(absPath))
+FolderContent::FolderContent(std::string path, std::string name, std::string type, bool isDirectory,
+    time_t modTime, bool hasSize, uintmax_t size, uintmax_t fileCount)
+    : mName(std::move(name)), mPath(std::move(path)), mType(std::move(type)), mIsDirectory(isDirectory),
+      mModTime(modTime), mSize(size), mFileCount(fileCount), mHasSize(hasSize)
+{
+}
+
+std::string FolderContent::getLastModTime()
+{
+    char timeStr[32];
+    if ((mModTime == 0) || !ctime_r(&mModTime, timeStr))
+        return std::string();
+    return timeStr;
+}
+
+static const char *getEntryTypeName(unsigned char type)
+{
+    static const char *names[] = { "unknown", "regular", "directory", "linkfile" };
+    return names[type];
+}
+
+FolderContents::FolderContents(std::string fullPath, ListOptions options)
+    : mFullPath(std::move(fullPath)), mOptions(std::move(options)), mTotalCount(0),
+      mSortedCount(0), mStatus(NO_ERROR)
 {
     init();
 }
 
-void FolderContent::init()
+void FolderContents::init()
 {
-    if (mPath.empty())  return;
-    mName = mPath.substr(mPath.rfind("/")+1);
-    mType = getFileType(mPath);
-    mSize = getFileSize(mPath);
-    mModTime = getModTime();
+    // Resolved once; the entries are then read and stat'ed relative to it
+    int fd = isRequestPath(mFullPath) ? PathHandles::getInstance().open(mFullPath, O_RDONLY | O_DIRECTORY) : -1;
+    DIR *dir = (fd < 0) ? NULL : fdopendir(fd);
+    if (!dir)
+    {
+        LOG_DEBUG_SAF("%s: %s: %s", __FUNCTION__, mFullPath.c_str(), strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        mStatus = INVALID_PATH;
+        return;
+    }
+    // readdir hands out getdents64 records, d_type included, so naming the
+    // entries costs no per-entry syscalls at all. Attributes are only read
+    // for the page that is actually returned.
+    while (struct dirent *entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        append(entry->d_name, entry->d_type);
+        if (!matches(mNameOffsets.size() - 1, dirfd(dir)))
+            dropLast();
+    }
+    closedir(dir);
+    mTotalCount = mNameOffsets.size();
+    mOrder.resize(mTotalCount);
+    for (std::uint32_t index = 0; index < mTotalCount; ++index)
+        mOrder[index] = index;
 }
 
-std::string FolderContent::getFileType(std::string filePath)
+void FolderContents::append(const char *name, unsigned char direntType)
 {
-    std::string type = "unknown";
-    try
+    mNameOffsets.push_back(mNamePool.size());
+    mNamePool.append(name, strlen(name) + 1);
+    mDirentTypes.push_back(direntType);
+    mTypes.push_back(TYPE_UNKNOWN);
+    mFlags.push_back(0);
+    mModTimes.push_back(0);
+    mSizes.push_back(0);
+    mFileCounts.push_back(0);
+}
+
+void FolderContents::dropLast()
+{
+    mNamePool.resize(mNameOffsets.back());
+    mNameOffsets.pop_back();
+    mDirentTypes.pop_back();
+    mTypes.pop_back();
+    mFlags.pop_back();
+    mModTimes.pop_back();
+    mSizes.pop_back();
+    mFileCounts.pop_back();
+}
+
+void FolderContents::load(std::uint32_t index, int dirFd, bool withTime)
+{
+    if (mFlags[index] & ENTRY_LOADED)
+        return;
+    mFlags[index] |= ENTRY_LOADED;
+    unsigned char direntType = mDirentTypes[index];
+    bool withDirSize = mOptions.mWithDirSize;
+    // d_type alone is enough for a directory whose size nobody asked for
+    if ((direntType == DT_DIR) && !withDirSize && !withTime)
     {
-        if (!validateInternalPath(filePath)) type = "unknown";
-        else if (fs::is_regular_file(filePath)) type = "regular";
-        else if (fs::is_symlink(filePath)) type = "linkfile";
-        else if (fs::is_directory(filePath)) type = "directory";
-#if 0
-        if (!fs::exists(filePath)) type = "unavailable";
-        else if (fs::is_block_file(filePath)) type = "block";
-        else if (fs::is_character_file(filePath)) type = "character";
-        else if (fs::is_fifo(filePath)) type = "fifo";
-        else if (fs::is_other(filePath)) type = "other";
-        else if (fs::is_socket(filePath)) type = "socket";
-        else if (fs::is_empty(filePath)) type = "empty";
-#endif
+        mTypes[index] = TYPE_DIRECTORY;
+        return;
     }
-    catch(fs::filesystem_error& e)
+    // Symlinks are followed, so a link to a file lists as that file; the
+    // cached attributes are fine on network mounts, hence DONT_SYNC
+    const char *name = getName(index);
+    struct statx stx;
+    bool known = (statx(dirFd, name, AT_STATX_DONT_SYNC,
+        STATX_TYPE | STATX_SIZE | STATX_MTIME, &stx) == 0);
+    bool isDir = known && S_ISDIR(stx.stx_mode);
+    if (known)
+        mModTimes[index] = stx.stx_mtime.tv_sec;
+    if (known && S_ISREG(stx.stx_mode))
     {
-        LOG_DEBUG_SAF("%s: %s", __FUNCTION__, e.what());
-        type = "unknown";
+        mTypes[index] = TYPE_REGULAR;
+        mFlags[index] |= ENTRY_HAS_SIZE;
+        mSizes[index] = stx.stx_size;
+        return;
+    }
+    bool isLink = (direntType == DT_LNK);
+    if (direntType == DT_UNKNOWN)
+    {
+        struct statx linkStx;
+        isLink = (statx(dirFd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+            STATX_TYPE, &linkStx) == 0) && S_ISLNK(linkStx.stx_mode);
     }
-    return type;
+    if (isLink)
+        mTypes[index] = TYPE_LINK;
+    else if (isDir)
+        mTypes[index] = TYPE_DIRECTORY;
+    if (!isDir || withDirSize)
+        mFlags[index] |= ENTRY_HAS_SIZE;
+    if (isDir && withDirSize)
+        DirSizeCache::getInstance().getTotals(mFullPath + "/" + name, mSizes[index], mFileCounts[index]);
 }
 
-uintmax_t FolderContent::getFileSize(std::string filePath)
+FolderContents::EntryType FolderContents::resolveType(std::uint32_t index, int dirFd)
 {
-    std::uintmax_t size = 0;
-    try
+    if (!(mFlags[index] & ENTRY_LOADED) && (mDirentTypes[index] == DT_REG))
+        return TYPE_REGULAR;
+    if (!(mFlags[index] & ENTRY_LOADED) && (mDirentTypes[index] == DT_DIR))
+        return TYPE_DIRECTORY;
+    load(index, dirFd);
+    return static_cast<EntryType>(mTypes[index]);
+}
+
+std::size_t FolderContents::getMemoryUsage()
+{
+    std::size_t perEntry = sizeof(std::uint32_t) * 2 + sizeof(unsigned char) * 3
+        + sizeof(time_t) + sizeof(uintmax_t) * 2;
+    return sizeof(FolderContents) + mFullPath.size() + mNamePool.capacity()
+        + perEntry * mNameOffsets.capacity();
+}
+
+bool FolderContents::matches(std::uint32_t index, int dirFd)
+{
+    const char *name = getName(index);
+    if (!mOptions.mNamePattern.empty()
+        && (fnmatch(mOptions.mNamePattern.c_str(), name, FNM_CASEFOLD) != 0))
+        return false;
+    if (!mOptions.mExtensions.empty())
     {
-        if (!validateInternalPath(filePath))
-            size = 0;
-        else if (fs::is_regular_file(filePath))
-            size = fs::file_size(filePath);
-        else if(fs::is_directory(filePath))
+        const char *dot = strrchr(name, '.');
+        if (!dot)
+            return false;
+        std::string extension = dot + 1;
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (std::find(mOptions.mExtensions.begin(), mOptions.mExtensions.end(), extension)
+            == mOptions.mExtensions.end())
+            return false;
+    }
+    // Checked last: it is the only test that may cost a statx
+    if (!mOptions.mType.empty() && (mOptions.mType != getEntryTypeName(resolveType(index, dirFd))))
+        return false;
+    return true;
+}
+
+void FolderContents::sortUpTo(std::uint32_t end, int dirFd)
+{
+    if ((mOptions.mSortBy == SortKey::UNSORTED) || (end <= mSortedCount))
+        return;
+    if (mSortedCount == 0)
+    {
+        // Folders always come first, so entries d_type cannot place need
+        // their inode; date and size orders need every entry's inode
+        for (std::uint32_t index = 0; index < mTotalCount; ++index)
         {
-            const std::filesystem::directory_options options = (
-                fs::directory_options::follow_directory_symlink |
-                fs::directory_options::skip_permission_denied);
-            for (const auto & entry : fs::directory_iterator(filePath, fs::directory_options(options)))
-            {
-                std::string entryPath = entry.path();
-                if (entryPath.find("/.") == std::string::npos)
-                    size += getFileSize(std::move(entryPath));
-            }
+            if (mOptions.mSortBy == SortKey::DATE)
+                load(index, dirFd, true);
+            else if (mOptions.mSortBy == SortKey::SIZE)
+                load(index, dirFd);
+            else
+                resolveType(index, dirFd);
         }
-        else
-            size = 0;
     }
-    catch(fs::filesystem_error& e)
+    SortKey sortBy = mOptions.mSortBy;
+    bool descending = mOptions.mDescending;
+    auto compare = [this, sortBy, descending](std::uint32_t lhs, std::uint32_t rhs)
+        {
+            if (isDirectory(lhs) != isDirectory(rhs))
+                return isDirectory(lhs);
+            int diff = 0;
+            if (sortBy == SortKey::DATE)
+                diff = (mModTimes[lhs] < mModTimes[rhs]) ? -1 : (mModTimes[lhs] > mModTimes[rhs]) ? 1 : 0;
+            else if (sortBy == SortKey::SIZE)
+                diff = (mSizes[lhs] < mSizes[rhs]) ? -1 : (mSizes[lhs] > mSizes[rhs]) ? 1 : 0;
+            if (diff == 0)
+                diff = strcasecmp(getName(lhs), getName(rhs));
+            if (diff == 0)
+                diff = strcmp(getName(lhs), getName(rhs));
+            return descending ? (diff > 0) : (diff < 0);
+        };
+    // Everything before mSortedCount is already final; order just enough of
+    // the rest to serve this page
+    std::partial_sort(mOrder.begin() + mSortedCount, mOrder.begin() + end, mOrder.end(), compare);
+    mSortedCount = end;
+}
+
+std::vector<FolderContent> FolderContents::getContents(std::uint32_t start, std::uint32_t end)
+{
+    std::vector<FolderContent> window;
+    std::lock_guard<std::mutex> lock(mMutex);
+    end = std::min<std::uint32_t>(end, mTotalCount);
+    if (start >= end)
+        return window;
+    int dirFd = PathHandles::getInstance().open(mFullPath, O_PATH | O_DIRECTORY);
+    sortUpTo(end, dirFd);
+    window.reserve(end - start);
+    for (std::uint32_t position = start; position < end; ++position)
     {
-        LOG_DEBUG_SAF("%s: %s", __FUNCTION__, e.what());
-        size = 0;
+        std::uint32_t index = mOrder[position];
+        if (dirFd >= 0)
+            load(index, dirFd);
+        const char *name = getName(index);
+        window.emplace_back(mFullPath + "/" + name, name, getEntryTypeName(mTypes[index]), isDirectory(index),
+            mModTimes[index], (mFlags[index] & ENTRY_HAS_SIZE) != 0, mSizes[index], mFileCounts[index]);
     }
-    return size;
+    if (dirFd >= 0)
+        close(dirFd);
+    return window;
 }
 
-std::string FolderContent::getModTime()
+ListingSnapshots& ListingSnapshots::getInstance()
 {
-    std::string timeStamp;
+    static ListingSnapshots obj;
+    return obj;
+}
+
+std::string ListingSnapshots::getCursor(const std::string& key,
+    std::shared_ptr<FolderContents> contents, std::uint32_t position)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::uint64_t id = 0;
+    for (auto& snapshot : mSnapshots)
+    {
+        if (snapshot.second.mContents == contents)
+        {
+            id = snapshot.first;
+            snapshot.second.mLastUsed = now;
+            break;
+        }
+    }
+    if (id == 0)
+    {
+        evict(now, contents->getTotalCount());
+        id = ++mNextId;
+        mSnapshots[id] = { key, contents, now };
+        mTotalEntries += contents->getTotalCount();
+    }
+    return std::to_string(id) + "." + std::to_string(position);
+}
+
+std::shared_ptr<FolderContents> ListingSnapshots::resolve(const std::string& key,
+    const std::string& cursor, std::uint32_t& position)
+{
+    std::uint64_t id = 0;
     try
     {
-        if (validateInternalPath(mPath))
+        std::size_t dot = cursor.find('.');
+        if (dot == std::string::npos)
+            return nullptr;
+        id = std::stoull(cursor.substr(0, dot));
+        position = (std::uint32_t)std::stoul(cursor.substr(dot + 1));
+    }
+    catch (std::exception& e)
+    {
+        LOG_DEBUG_SAF("%s: malformed cursor [%s]", __FUNCTION__, cursor.c_str());
+        return nullptr;
+    }
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mMutex);
+    evict(now, 0);
+    auto itr = mSnapshots.find(id);
+    if ((itr == mSnapshots.end()) || (itr->second.mKey != key))
+        return nullptr;
+    itr->second.mLastUsed = now;
+    return itr->second.mContents;
+}
+
+void ListingSnapshots::evict(std::chrono::steady_clock::time_point now, std::size_t incoming)
+{
+    for (auto itr = mSnapshots.begin(); itr != mSnapshots.end();)
+    {
+        if ((now - itr->second.mLastUsed) >= std::chrono::seconds(SAF_LIST_SNAPSHOT_TTL_SEC))
         {
-            using namespace std::chrono_literals;
-            auto ftime = fs::last_write_time(mPath);
-            auto timeMs = std::chrono::time_point_cast<std::chrono::milliseconds>(ftime);
-            char *sTimeMs = ctime((time_t*)&timeMs);
-            if (sTimeMs)
-                timeStamp = sTimeMs;
+            mTotalEntries -= itr->second.mContents->getTotalCount();
+            itr = mSnapshots.erase(itr);
         }
+        else
+            ++itr;
     }
-    catch(fs::filesystem_error& e)
+    // Still over budget: drop the least recently used ones
+    while (!mSnapshots.empty() && ((mSnapshots.size() >= SAF_LIST_SNAPSHOT_MAX_COUNT)
+        || ((mTotalEntries + incoming) > SAF_LIST_SNAPSHOT_MAX_ENTRIES)))
     {
-        LOG_DEBUG_SAF("%s: %s", __FUNCTION__, e.what());
-        timeStamp.clear();
+        auto oldest = mSnapshots.begin();
+        for (auto itr = mSnapshots.begin(); itr != mSnapshots.end(); ++itr)
+        {
+            if (itr->second.mLastUsed < oldest->second.mLastUsed)
+                oldest = itr;
+        }
+        mTotalEntries -= oldest->second.mContents->getTotalCount();
+        mSnapshots.erase(oldest);
     }
-    return timeStamp;
 }
 
-FolderContents::FolderContents(std::string fullPath) : mFullPath(std::move(fullPath)), mStatus(NO_ERROR)
+DirSizeCache& DirSizeCache::getInstance()
 {
-    init();
+    static DirSizeCache obj;
+    return obj;
 }
 
-void FolderContents::init()
+uintmax_t DirSizeCache::getSize(const std::string& path)
 {
-    try
+    uintmax_t size = 0;
+    uintmax_t files = 0;
+    getTotals(path, size, files);
+    return size;
+}
+
+void DirSizeCache::getTotals(const std::string& path, uintmax_t& size, uintmax_t& files)
+{
+    uint64_t indexBytes = 0;
+    uint64_t indexFiles = 0;
+    if (SizeIndex::getInstance().getTotals(path, indexBytes, indexFiles))
+    {
+        size = indexBytes;
+        files = indexFiles;
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
     {
-        if (!validateInternalPath(mFullPath))
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto itr = mEntries.find(path);
+        if ((itr != mEntries.end()) && ((now - itr->second.mTime) < std::chrono::seconds(SAF_DIR_SIZE_TTL_SEC)))
         {
-            mStatus = INVALID_PATH;
+            size = itr->second.mSize;
+            files = itr->second.mFiles;
             return;
         }
-        mContents.clear();
-        const std::filesystem::directory_options options = (
-            fs::directory_options::follow_directory_symlink |
-            fs::directory_options::skip_permission_denied);
-        for (const auto & entry : fs::directory_iterator(mFullPath, fs::directory_options(options)))
+    }
+    // Walk without the lock; two lists racing on one folder just both walk it
+    files = 0;
+    size = computeSize(path, files);
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mEntries.size() >= SAF_DIR_SIZE_MAX_ENTRIES)
+    {
+        for (auto itr = mEntries.begin(); itr != mEntries.end();)
         {
-            std::string entryPath = entry.path();
-            if (entryPath.find("/.") == std::string::npos)
-            {
-                std::shared_ptr<FolderContent> folderObj = std::shared_ptr<FolderContent>(new FolderContent(std::move(entryPath)));
-                mContents.push_back(folderObj);
-                //LOG_DEBUG_SAF("%s: Path: %s, Total: %d", __FUNCTION__, entry.path().c_str(), mContents.size());
-            }
+            if ((now - itr->second.mTime) >= std::chrono::seconds(SAF_DIR_SIZE_TTL_SEC))
+                itr = mEntries.erase(itr);
+            else
+                ++itr;
         }
+        if (mEntries.size() >= SAF_DIR_SIZE_MAX_ENTRIES)
+            mEntries.clear();
     }
-    catch(fs::filesystem_error& e)
+    mEntries[path] = { size, files, now };
+}
+
+typedef std::function<void(const std::string&, const struct stat&)> TreeVisitor;
+
+// Walks the tree under dirFd (which it takes over), opening each directory
+// and stat'ing each entry relative to its parent, so no full path is looked
+// up again. Directories are visited before their contents; symlinks are
+// visited but never followed. Returns 0 or the errno of the first failure;
+// with skipDenied, directories that cannot be read are left out instead.
+static int walkTree(int dirFd, const std::string& path, bool withHidden, bool skipDenied,
+    const TreeVisitor& visit)
+{
+    DIR *dir = fdopendir(dirFd);
+    if (!dir)
     {
-        LOG_DEBUG_SAF("%s: %s", __FUNCTION__, e.what());
-        mTotalCount = 0;
-        mStatus = INVALID_PATH;
+        int err = errno;
+        close(dirFd);
+        return err;
+    }
+    int err = 0;
+    while (struct dirent *entry = readdir(dir))
+    {
+        const char *name = entry->d_name;
+        if ((strcmp(name, ".") == 0) || (strcmp(name, "..") == 0) || (!withHidden && (name[0] == '.')))
+            continue;
+        struct stat entryStat;
+        if (fstatat(dirfd(dir), name, &entryStat, AT_SYMLINK_NOFOLLOW) < 0)
+        {
+            err = errno;
+            break;
+        }
+        std::string entryPath = path + "/" + name;
+        visit(entryPath, entryStat);
+        if (!S_ISDIR(entryStat.st_mode))
+            continue;
+        int childFd = openat(dirfd(dir), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        err = (childFd < 0) ? errno : walkTree(childFd, entryPath, withHidden, skipDenied, visit);
+        if (skipDenied && (err == EACCES))
+            err = 0;
+        if (err != 0)
+            break;
     }
-    mTotalCount = mContents.size();
+    closedir(dir);
+    return err;
 }
 
-InternalSpaceInfo::InternalSpaceInfo(std::string path) : mPath(std::move(path)), mStatus(NO_ERROR)
+uintmax_t DirSizeCache::computeSize(const std::string& path, uintmax_t& files)
 {
-    init();
+    uintmax_t size = 0;
+    int fd = PathHandles::getInstance().open(path, O_RDONLY | O_DIRECTORY);
+    // Hidden entries are not listed, so they do not count either
+    int err = (fd < 0) ? errno : walkTree(fd, path, false, true,
+        [&size, &files](const std::string&, const struct stat& entryStat)
+        {
+            if (S_ISREG(entryStat.st_mode))
+            {
+                size += entryStat.st_size;
+                ++files;
+            }
+        });
+    if (err != 0)
+        LOG_DEBUG_SAF("%s: %s: %s", __FUNCTION__, path.c_str(), strerror(err));
+    return size;
 }
 
-void InternalSpaceInfo::init()
+void DirSizeCache::invalidate(const std::string& path)
 {
-    try
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto itr = mEntries.begin(); itr != mEntries.end();)
+    {
+        const std::string& key = itr->first;
+        bool isAncestor = (path.compare(0, key.size(), key) == 0)
+            && ((path.size() == key.size()) || (path[key.size()] == '/'));
+        bool isDescendant = (key.compare(0, path.size(), path) == 0)
+            && ((key.size() > path.size()) && (key[path.size()] == '/'));
+        if (isAncestor || isDescendant)
+            itr = mEntries.erase(itr);
+        else
+            ++itr;
+    }
+}
+
+VolumeInfoCache& VolumeInfoCache::getInstance()
+{
+    static VolumeInfoCache obj;
+    return obj;
+}
+
+bool VolumeInfoCache::get(int fd, dev_t dev, VolumeInfo& info)
+{
+    auto now = std::chrono::steady_clock::now();
     {
-        if (!validateInternalPath(mPath))
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto itr = mEntries.find(dev);
+        if ((itr != mEntries.end()) && ((now - itr->second.mTime) < std::chrono::milliseconds(SAF_VOLUME_INFO_TTL_MS)))
         {
-            mStatus = INVALID_PATH;
-            return;
+            info = itr->second.mInfo;
+            return true;
         }
-        fs::space_info dev = fs::space(mPath);
-        mCapacity = dev.capacity;
-        mFreeSpace = dev.free;
-        mAvailSpace = dev.available;
-        fs::perms ps = fs::status(mPath).permissions();
-        mIsWritable = ((ps & fs::perms::owner_write) != fs::perms::none);
-        mIsDeletable = ((ps & fs::perms::group_write) != fs::perms::none);
-        mStatus = SUCCESS;
     }
-    catch(fs::filesystem_error& e)
+    struct statvfs vfs;
+    if (fstatvfs(fd, &vfs) < 0)
+        return false;
+    info.mCapacity = (uint64_t)vfs.f_blocks * vfs.f_frsize;
+    info.mFree = (uint64_t)vfs.f_bfree * vfs.f_frsize;
+    info.mAvail = (uint64_t)vfs.f_bavail * vfs.f_frsize;
+    std::lock_guard<std::mutex> lock(mMutex);
+    // Unplugged drives would otherwise stay here for good
+    for (auto itr = mEntries.begin(); itr != mEntries.end();)
     {
-        LOG_DEBUG_SAF("%s: %s", __FUNCTION__, e.what());
+        if ((now - itr->second.mTime) >= std::chrono::milliseconds(SAF_VOLUME_INFO_TTL_MS))
+            itr = mEntries.erase(itr);
+        else
+            ++itr;
+    }
+    mEntries[dev] = { info, now };
+    return true;
+}
+
+void VolumeInfoCache::invalidate(const std::string& path)
+{
+    // A removed path is gone already; its nearest remaining parent is on the same volume
+    struct stat pathStat;
+    fs::path target(path);
+    bool found = false;
+    while (!(found = (stat(target.c_str(), &pathStat) == 0)) && target.has_relative_path())
+        target = target.parent_path();
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (found)
+        mEntries.erase(pathStat.st_dev);
+}
+
+InternalSpaceInfo::InternalSpaceInfo(std::string path) : mPath(std::move(path)), mVolume(),
+    mHasTotals(false), mTotalBytes(0), mFileCount(0), mStatus(NO_ERROR)
+{
+    init();
+}
+
+void InternalSpaceInfo::init()
+{
+    // One resolution serves the permissions, the device and the statvfs
+    int fd = isRequestPath(mPath) ? PathHandles::getInstance().open(mPath, O_PATH) : -1;
+    struct stat pathStat;
+    if ((fd < 0) || (fstat(fd, &pathStat) < 0) || !VolumeInfoCache::getInstance().get(fd, pathStat.st_dev, mVolume))
+    {
+        LOG_DEBUG_SAF("%s: %s: %s", __FUNCTION__, mPath.c_str(), strerror(errno));
+        if (fd >= 0)
+            close(fd);
         mStatus = INVALID_PATH;
+        return;
     }
+    close(fd);
+    mIsWritable = ((pathStat.st_mode & S_IWUSR) != 0);
+    mIsDeletable = ((pathStat.st_mode & S_IWGRP) != 0);
+    // Never walks: without a ready index the totals are just left out
+    mHasTotals = SizeIndex::getInstance().getTotals(mPath, mTotalBytes, mFileCount);
+    mStatus = SUCCESS;
 }
 
 std::uint32_t InternalSpaceInfo::getCapacityMB()
 {
-    return mCapacity / 1000000;
+    return (std::uint32_t)(mVolume.mCapacity / 1000000);
 }
 
 std::uint32_t InternalSpaceInfo::getFreeSpaceMB()
 {
-    return mFreeSpace / 1000000;
+    return (std::uint32_t)(mVolume.mFree / 1000000);
 }
 
 std::uint32_t InternalSpaceInfo::getAvailSpaceMB()
 {
-    return mAvailSpace / 1000000;
+    return (std::uint32_t)(mVolume.mAvail / 1000000);
 }
 
 bool InternalSpaceInfo::getIsWritable()
@@ -450,8 +956,273 @@ int32_t InternalSpaceInfo::getStatus()
 }
 
 
-InternalCopy::InternalCopy(std::string src, std::string dest, bool overwrite)
-    : mSrcPath(std::move(src)), mDestPath(std::move(dest)), mStatus(NO_ERROR), mOverwrite(overwrite)
+void TransferManifest::build(const std::string& srcPath, const std::string& destPath)
+{
+    mDirs.clear();
+    mFiles.clear();
+    mTotalBytes = 0;
+    struct stat srcStat;
+    int pathFd = PathHandles::getInstance().open(srcPath, O_PATH);
+    if ((pathFd < 0) || (fstat(pathFd, &srcStat) < 0))
+    {
+        int err = errno;
+        if (pathFd >= 0)
+            close(pathFd);
+        throw fs::filesystem_error("cannot read source", srcPath, std::error_code(err, std::generic_category()));
+    }
+    if (!S_ISDIR(srcStat.st_mode))
+    {
+        close(pathFd);
+        mFiles.push_back({srcPath, (fs::path(destPath) / fs::path(srcPath).filename()).string(),
+            (uint64_t)srcStat.st_size});
+        mTotalBytes = srcStat.st_size;
+        return;
+    }
+    int fd = openat(pathFd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    close(pathFd);
+    int err = (fd < 0) ? errno : walkTree(fd, srcPath, true, false,
+        [this, &srcPath, &destPath](const std::string& path, const struct stat& entryStat)
+        {
+            std::string target = destPath + path.substr(srcPath.size());
+            if (S_ISDIR(entryStat.st_mode))
+            {
+                mDirs.push_back(std::move(target));
+            }
+            else if (S_ISREG(entryStat.st_mode))
+            {
+                mFiles.push_back({path, std::move(target), (uint64_t)entryStat.st_size});
+                mTotalBytes += entryStat.st_size;
+            }
+        });
+    if (err != 0)
+        throw fs::filesystem_error("cannot read source tree", srcPath, std::error_code(err, std::generic_category()));
+}
+
+TransferCounters::TransferCounters()
+    : mTotalBytes(0), mTotalFiles(0), mBytesDone(0), mFilesDone(0)
+{
+}
+
+void TransferCounters::plan(TransferManifest& manifest)
+{
+    mTotalBytes = manifest.getTotalBytes();
+    mTotalFiles = manifest.getFiles().size();
+}
+
+void TransferCounters::add(uint64_t bytes, uint64_t files)
+{
+    mBytesDone += bytes;
+    mFilesDone += files;
+}
+
+int32_t TransferCounters::getPercent()
+{
+    uint64_t done = mBytesDone;
+    if (mTotalBytes == 0)
+        return NO_ERROR;
+    // Stay below SUCCESS until the engine itself reports completion
+    if (done >= mTotalBytes)
+        return (SUCCESS - 1);
+    return (int32_t)((done * SUCCESS) / mTotalBytes);
+}
+
+// Copies one regular file through the copy engine, feeding every chunk into
+// the counters and the job so progress, pause and cancel work mid-file.
+// With removeSource the source is unlinked once the copy is verified.
+static int32_t copyFile(const fs::path& src, const fs::path& target, uint64_t size, bool overwrite,
+    TransferCounters& counters, std::shared_ptr<TransferJob> job, bool removeSource)
+{
+    int32_t status = SAFCopyEngine::getInstance().copyFile(src.string(), target.string(), overwrite,
+        [&counters, &job](uint64_t bytes)
+        {
+            counters.add(bytes, 0);
+            if (!job)
+                return true;
+            job->addProgress(bytes, 0);
+            return job->checkpoint();
+        });
+    // An existing file is skipped when overwrite is off; it still counts as done
+    bool skipped = false;
+    if ((status == FILE_ALREADY_EXISTS) && !overwrite)
+    {
+        counters.add(size, 0);
+        if (job)
+            job->addProgress(size, 0);
+        status = SUCCESS;
+        skipped = true;
+    }
+    if (status != SUCCESS)
+    {
+        LOG_DEBUG_SAF("%s: %s failed: %d", __FUNCTION__, src.c_str(), status);
+        return status;
+    }
+    if (removeSource && !skipped)
+    {
+        struct stat destStat;
+        if ((stat(target.c_str(), &destStat) < 0) || ((uint64_t)destStat.st_size != size))
+        {
+            LOG_DEBUG_SAF("%s: %s does not match its source", __FUNCTION__, target.c_str());
+            return UNKNOWN;
+        }
+        if (unlinkBeneath(src, 0) < 0)
+            return PERMISSION_DENIED;
+    }
+    counters.add(0, 1);
+    if (job)
+        job->addProgress(0, 1);
+    return SUCCESS;
+}
+
+// Counts dev as busy for eject while it lives: reads and removes hold the
+// volume open just as writes do, so eject must wait for them too
+class DeviceTransfer
+{
+private:
+    dev_t mDev;
+public:
+    explicit DeviceTransfer(dev_t dev) : mDev(dev) { SAFCopyEngine::getInstance().beginTransfer(mDev); }
+    ~DeviceTransfer() { SAFCopyEngine::getInstance().endTransfer(mDev); }
+    DeviceTransfer(const DeviceTransfer&) = delete;
+    DeviceTransfer& operator=(const DeviceTransfer&) = delete;
+};
+
+// Shared by the streams of one parallel copy or remove. Helpers that start
+// after the coordinator has closed it leave without touching anything else.
+struct ParallelCopyState
+{
+    std::mutex mMutex;
+    std::condition_variable mCondVar;
+    std::atomic<size_t> mNextBatch{0};
+    std::atomic<int32_t> mStatus{SUCCESS};
+    size_t mActive = 0;
+    bool mClosed = false;
+};
+
+// Creates the directory skeleton of the manifest, then copies its files on
+// several streams. Small files are grouped into batches so one stream does
+// many of them per claim; large files get a batch of their own. The number
+// of streams, and the streams active on a device across all copies, are
+// capped by SAFCopyEngine so a slow USB disk is not flooded.
+static int32_t copyTree(TransferManifest& manifest, bool overwrite,
+    TransferCounters& counters, std::shared_ptr<TransferJob> job, bool removeSource = false)
+{
+    auto& files = manifest.getFiles();
+    // A FAT32 target cannot take a 4 GB file; refuse before anything is created
+    if (!files.empty())
+    {
+        const TransferProfile& profile = SAFCopyEngine::getPathProfile(files[0].mDestPath);
+        for (const auto& file : files)
+        {
+            if (profile.mMaxFileSize && (file.mSize > profile.mMaxFileSize))
+            {
+                LOG_DEBUG_SAF("%s: %s is too large for %s", __FUNCTION__, file.mSrcPath.c_str(), profile.mName);
+                return FILE_TOO_LARGE;
+            }
+        }
+    }
+    for (auto& dir : manifest.getDirs())
+        createDirsBeneath(dir);
+    if (files.empty())
+        return SUCCESS;
+
+    std::vector<std::pair<size_t, size_t>> batches;
+    for (size_t begin = 0; begin < files.size();)
+    {
+        size_t end = begin + 1;
+        uint64_t bytes = files[begin].mSize;
+        while ((end < files.size()) && (bytes < SAF_COPY_BATCH_BYTES) && ((end - begin) < SAF_COPY_BATCH_FILES)
+            && (files[begin].mSize < SAF_COPY_SMALL_FILE_SIZE) && (files[end].mSize < SAF_COPY_SMALL_FILE_SIZE))
+        {
+            bytes += files[end].mSize;
+            ++end;
+        }
+        batches.push_back(std::make_pair(begin, end));
+        begin = end;
+    }
+
+    struct stat srcStat;
+    struct stat destStat;
+    if ((stat(files[0].mSrcPath.c_str(), &srcStat) < 0)
+        || (stat(fs::path(files[0].mDestPath).parent_path().c_str(), &destStat) < 0))
+        return INVALID_PATH;
+    dev_t srcDev = srcStat.st_dev;
+    dev_t destDev = destStat.st_dev;
+    SAFCopyEngine& engine = SAFCopyEngine::getInstance();
+
+    auto state = std::make_shared<ParallelCopyState>();
+    auto runStream = [state, &batches, &files, overwrite, &counters, job, removeSource, srcDev, destDev, &engine]()
+        {
+            size_t index;
+            while ((state->mStatus == SUCCESS) && ((index = state->mNextBatch++) < batches.size()))
+            {
+                engine.acquireDevices(srcDev, destDev);
+                for (size_t i = batches[index].first; i < batches[index].second; ++i)
+                {
+                    int32_t status = OPERATION_CANCELLED;
+                    if (!job || job->checkpoint())
+                        status = copyFile(files[i].mSrcPath, files[i].mDestPath, files[i].mSize,
+                            overwrite, counters, job, removeSource);
+                    if (status != SUCCESS)
+                    {
+                        int32_t expected = SUCCESS;
+                        state->mStatus.compare_exchange_strong(expected, status);
+                        break;
+                    }
+                }
+                engine.releaseDevices(srcDev, destDev);
+            }
+        };
+
+    DeviceTransfer srcBusy(srcDev);
+    DeviceTransfer destBusy(destDev);
+    size_t streams = std::min(engine.getDeviceLimit(srcDev), engine.getDeviceLimit(destDev));
+    streams = std::min(streams, SAFWorkerPool::getInstance().getWorkerCount());
+    streams = std::min(streams, batches.size());
+    for (size_t i = 1; i < streams; ++i)
+    {
+        SAFWorkerPool::getInstance().submit([state, runStream]()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(state->mMutex);
+                    if (state->mClosed)
+                        return;
+                    ++state->mActive;
+                }
+                runStream();
+                {
+                    std::lock_guard<std::mutex> lock(state->mMutex);
+                    --state->mActive;
+                }
+                state->mCondVar.notify_all();
+            }, TaskLane::BULK);
+    }
+    // The coordinator works too, so the copy finishes even when no helper
+    // gets a worker; it then waits only for helpers that actually started.
+    runStream();
+    std::unique_lock<std::mutex> lock(state->mMutex);
+    state->mClosed = true;
+    state->mCondVar.wait(lock, [&state] { return (state->mActive == 0); });
+    return state->mStatus;
+}
+
+// Removes the directories left behind by a move, deepest first. Directories
+// that still hold skipped files or symlinks stay where they are.
+static void removeEmptyDirs(const std::string& path)
+{
+    if (!fs::is_directory(path))
+        return;
+    std::vector<std::string> dirs = { path };
+    for (auto itr = fs::recursive_directory_iterator(path); itr != fs::recursive_directory_iterator(); ++itr)
+    {
+        if (!itr->is_symlink() && itr->is_directory())
+            dirs.push_back(itr->path().string());
+    }
+    for (auto itr = dirs.rbegin(); itr != dirs.rend(); ++itr)
+        rmdir(itr->c_str());
+}
+
+InternalCopy::InternalCopy(std::string src, std::string dest, bool overwrite, std::shared_ptr<TransferJob> job)
+    : mSrcPath(std::move(src)), mDestPath(std::move(dest)), mStatus(NO_ERROR), mOverwrite(overwrite), mJob(std::move(job))
 {
     init();
 }
@@ -479,7 +1250,7 @@ void InternalCopy::init()
         if (fs::is_directory(mSrcPath))
         {
             if (!fs::exists(desPath))
-                fs::create_directories(desPath);
+                createDirsBeneath(desPath);
             mDestPath = std::move(desPath);
         }
     }
@@ -489,68 +1260,357 @@ void InternalCopy::init()
         mStatus = PERMISSION_DENIED;
         return;
     }
-    mSrcSize = FolderContent(mSrcPath).getSize();
-    mDestSize = FolderContent(mDestPath).getSize();
-    std::async(std::launch::async, [this]()
+    try
+    {
+        TransferManifest manifest;
+        manifest.build(mSrcPath, mDestPath);
+        mCounters.plan(manifest);
+        if (mJob)
         {
-            try
+            mJob->setTotal(mCounters.getTotalBytes(), mCounters.getTotalFiles());
+            if (!mJob->start())
             {
-                auto copyOptions = fs::copy_options::recursive
-                           | fs::copy_options::skip_symlinks;
-                if (this->mOverwrite)
-                    copyOptions |= fs::copy_options::overwrite_existing;
-                else
-                    copyOptions |= fs::copy_options::skip_existing;
-                fs::copy(this->mSrcPath, this->mDestPath, copyOptions);
-                this->mStatus = SUCCESS;
+                mStatus = OPERATION_CANCELLED;
+                return;
             }
-            catch(fs::filesystem_error& e)
+        }
+        mStatus = copyTree(manifest, mOverwrite, mCounters, mJob);
+    }
+    catch(fs::filesystem_error& e)
+    {
+        LOG_DEBUG_SAF("%s", e.what());
+        mStatus = PERMISSION_DENIED;
+    }
+}
+
+std::int32_t InternalCopy::getStatus()
+{
+    if (mStatus != NO_ERROR)
+        return mStatus;
+    return mCounters.getPercent();
+}
+
+static int32_t getRemoveStatus(int err)
+{
+    switch(err)
+    {
+        case EACCES:
+        case EPERM:
+        case EROFS:
+        case EBUSY:
+            return PERMISSION_DENIED;
+        case ENOENT:
+        case EXDEV:
+        case ELOOP:
+            return INVALID_PATH;
+        default:
+            return UNKNOWN;
+    }
+}
+
+// One pass over the tree, never following symlinks: every directory in
+// discovery order (parents before children) and the number of entries,
+// the tree itself included, so progress has a total to count against.
+static int32_t scanRemoveTree(const std::string& path, std::vector<std::string>& dirs, uint64_t& entries)
+{
+    dirs.push_back(path);
+    entries = 1;
+    for (size_t i = 0; i < dirs.size(); ++i)
+    {
+        int fd = PathHandles::getInstance().open(dirs[i], O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        DIR *dir = (fd < 0) ? NULL : fdopendir(fd);
+        if (!dir)
+        {
+            int err = errno;
+            if (fd >= 0)
+                close(fd);
+            if (err == ENOENT)
+                continue;
+            return getRemoveStatus(err);
+        }
+        while (struct dirent *entry = readdir(dir))
+        {
+            if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+                continue;
+            ++entries;
+            bool isDir = (entry->d_type == DT_DIR);
+            struct stat st;
+            if ((entry->d_type == DT_UNKNOWN) && (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0))
+                isDir = S_ISDIR(st.st_mode);
+            if (isDir)
+                dirs.push_back(dirs[i] + "/" + entry->d_name);
+        }
+        closedir(dir);
+    }
+    return SUCCESS;
+}
+
+// Unlinks everything but the subdirectories of one directory, through its fd
+static int32_t unlinkDirFiles(const std::string& path, const std::shared_ptr<TransferJob>& job)
+{
+    int fd = PathHandles::getInstance().open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    DIR *dir = (fd < 0) ? NULL : fdopendir(fd);
+    if (!dir)
+    {
+        int err = errno;
+        if (fd >= 0)
+            close(fd);
+        return (err == ENOENT) ? SUCCESS : getRemoveStatus(err);
+    }
+    int32_t status = SUCCESS;
+    while (struct dirent *entry = readdir(dir))
+    {
+        if ((entry->d_type == DT_DIR) || (strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+            continue;
+        if (job && !job->checkpoint())
+        {
+            status = OPERATION_CANCELLED;
+            break;
+        }
+        if (unlinkat(dirfd(dir), entry->d_name, 0) < 0)
+        {
+            // EISDIR: a directory behind DT_UNKNOWN, removed in the second phase
+            if ((errno == EISDIR) || (errno == ENOENT))
+                continue;
+            status = getRemoveStatus(errno);
+            break;
+        }
+        if (job)
+            job->addProgress(0, 1);
+    }
+    closedir(dir);
+    return status;
+}
+
+// Puts the calling worker in the idle I/O class while it lives, when
+// enabled. Pool threads serve other requests afterwards, so the old class
+// is restored.
+class IdleIoPriority
+{
+private:
+    long mOldPrio;
+public:
+    explicit IdleIoPriority(bool enable = true) : mOldPrio(-1)
+    {
+        if (!enable)
+            return;
+        mOldPrio = syscall(SYS_ioprio_get, SAF_IOPRIO_WHO_PROCESS, 0);
+        syscall(SYS_ioprio_set, SAF_IOPRIO_WHO_PROCESS, 0, SAF_IOPRIO_CLASS_IDLE << SAF_IOPRIO_CLASS_SHIFT);
+    }
+    ~IdleIoPriority()
+    {
+        // Class NONE (priority derived from nice) only accepts a zero level
+        if ((mOldPrio >> SAF_IOPRIO_CLASS_SHIFT) == 0)
+            mOldPrio = 0;
+        if (mOldPrio >= 0)
+            syscall(SYS_ioprio_set, SAF_IOPRIO_WHO_PROCESS, 0, mOldPrio);
+    }
+};
+
+// Deletes a tree in two phases. First the files of every directory are
+// unlinked, directories spread over several streams so wide and deep
+// trees both parallelize; then the emptied directories are removed
+// deepest first. Each entry is reported to the job as it goes, and a
+// cancelled job stops at the next entry, leaving the rest in place.
+// An idle removal runs every stream in the idle I/O class, not just the
+// calling thread.
+static int32_t removeTree(const std::string& path, std::shared_ptr<TransferJob> job, bool idle = false)
+{
+    struct stat st;
+    if (lstat(path.c_str(), &st) < 0)
+        return getRemoveStatus(errno);
+    DeviceTransfer busy(st.st_dev);
+    if (!S_ISDIR(st.st_mode))
+    {
+        if (job)
+            job->setTotal(0, 1);
+        if (unlinkBeneath(path, 0) < 0)
+            return getRemoveStatus(errno);
+        if (job)
+            job->addProgress(0, 1);
+        return SUCCESS;
+    }
+    std::vector<std::string> dirs;
+    uint64_t entries = 0;
+    int32_t status = scanRemoveTree(path, dirs, entries);
+    if (status != SUCCESS)
+        return status;
+    if (job)
+        job->setTotal(0, entries);
+
+    SAFCopyEngine& engine = SAFCopyEngine::getInstance();
+    dev_t dev = st.st_dev;
+    auto state = std::make_shared<ParallelCopyState>();
+    auto runStream = [state, &dirs, job, dev, &engine, idle]()
+        {
+            IdleIoPriority priority(idle);
+            size_t index;
+            while ((state->mStatus == SUCCESS) && ((index = state->mNextBatch++) < dirs.size()))
             {
-                LOG_DEBUG_SAF("%s", e.what());
-                this->mStatus = PERMISSION_DENIED;
+                engine.acquireDevices(dev, dev);
+                int32_t status = unlinkDirFiles(dirs[index], job);
+                engine.releaseDevices(dev, dev);
+                if (status != SUCCESS)
+                {
+                    int32_t expected = SUCCESS;
+                    state->mStatus.compare_exchange_strong(expected, status);
+                }
             }
-        });
+        };
+    size_t streams = std::min(engine.getDeviceLimit(dev), SAFWorkerPool::getInstance().getWorkerCount());
+    streams = std::min(streams, dirs.size());
+    for (size_t i = 1; i < streams; ++i)
+    {
+        SAFWorkerPool::getInstance().submit([state, runStream]()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(state->mMutex);
+                    if (state->mClosed)
+                        return;
+                    ++state->mActive;
+                }
+                runStream();
+                {
+                    std::lock_guard<std::mutex> lock(state->mMutex);
+                    --state->mActive;
+                }
+                state->mCondVar.notify_all();
+            }, TaskLane::BULK);
+    }
+    runStream();
+    {
+        std::unique_lock<std::mutex> lock(state->mMutex);
+        state->mClosed = true;
+        state->mCondVar.wait(lock, [&state] { return (state->mActive == 0); });
+    }
+    if (state->mStatus != SUCCESS)
+        return state->mStatus;
+
+    for (auto itr = dirs.rbegin(); itr != dirs.rend(); ++itr)
+    {
+        if (job && !job->checkpoint())
+            return OPERATION_CANCELLED;
+        if ((unlinkBeneath(*itr, AT_REMOVEDIR) < 0) && (errno != ENOENT))
+            return getRemoveStatus(errno);
+        if (job)
+            job->addProgress(0, 1);
+    }
+    return SUCCESS;
 }
 
-std::int32_t InternalCopy::getStatus()
+// Empties a purge folder and then removes it. Entries left behind by an
+// earlier purge that did not finish go too; whatever fails stays hidden
+// until the next purge of that root.
+static void purgeDetached(const std::string& purgeDir)
 {
-    if(mStatus < 0)
+    std::vector<std::string> entries;
+    struct stat st;
+    if (stat(purgeDir.c_str(), &st) < 0)
+        return;
+    DeviceTransfer busy(st.st_dev);
+    DIR *dir = opendir(purgeDir.c_str());
+    if (!dir)
+        return;
+    while (struct dirent *entry = readdir(dir))
     {
-        return mStatus;
+        if ((strcmp(entry->d_name, ".") != 0) && (strcmp(entry->d_name, "..") != 0))
+            entries.push_back(purgeDir + "/" + entry->d_name);
     }
-    uint32_t size = FolderContent(mDestPath).getSize();
-    mDestSize = size;
-    uint32_t change = (mSrcSize - size + mDestSize);
-    if ((mStatus >= NO_ERROR) && (change > 0))
-        mStatus = int(change / mSrcSize * 100);
-    else if ((mStatus >= NO_ERROR) && (change == 0))
-        mStatus = SUCCESS;
-    return mStatus;
+    closedir(dir);
+    IdleIoPriority idle;
+    for (auto& entry : entries)
+    {
+        int32_t status = removeTree(entry, nullptr, true);
+        if (status != SUCCESS)
+            LOG_DEBUG_SAF("%s: %s not purged: %d", __FUNCTION__, entry.c_str(), status);
+    }
+    rmdir(purgeDir.c_str());
+    VolumeInfoCache::getInstance().invalidate(purgeDir);
+}
+
+// A name for an entry of the purge or trash folder: creation time first,
+// so names sort oldest first, and a sequence for requests in the same ms
+static std::string getUniqueName()
+{
+    static std::atomic<uint64_t> sequence{0};
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::ostringstream name;
+    name << std::setw(14) << std::setfill('0') << now << "." << ++sequence;
+    return name.str();
 }
 
-InternalRemove::InternalRemove(std::string path)
-    : mPath(std::move(path)), mStatus(NO_ERROR)
+static bool isUnderRoot(const std::string& path, const std::string& root)
+{
+    return !root.empty() && (path.compare(0, root.size() + 1, root + "/") == 0);
+}
+
+// The trash and purge folders of root and what is in them; a sibling such
+// as ".saf-trash2" is an ordinary entry
+static bool isServicePath(const std::string& path, const std::string& root)
+{
+    for (const char *name : { SAF_TRASH_DIR_NAME, SAF_PURGE_DIR_NAME })
+    {
+        std::string dir = root + "/" + name;
+        if ((path == dir) || isUnderRoot(path, dir))
+            return true;
+    }
+    return false;
+}
+
+// Takes a tree out of its storage root with a single rename into the
+// root's hidden purge folder and deletes it from there on a bulk worker.
+// Only done under a root the service owns, so the rename stays on one
+// filesystem; false means the caller has to remove the tree itself.
+static bool detachTree(const std::string& path, const std::string& root)
+{
+    if (!isUnderRoot(path, root))
+        return false;
+    std::string purgeDir = root + "/" + SAF_PURGE_DIR_NAME;
+    PathHandles& handles = PathHandles::getInstance();
+    std::string leaf;
+    int srcFd = handles.openParent(root, path, leaf);
+    int purgeFd = (srcFd < 0) ? -1 : handles.makeDirs(root, purgeDir, 0700);
+    bool detached = (purgeFd >= 0)
+        && (renameat2(srcFd, leaf.c_str(), purgeFd, getUniqueName().c_str(), RENAME_NOREPLACE) == 0);
+    int err = errno;
+    if (purgeFd >= 0)
+        close(purgeFd);
+    if (srcFd >= 0)
+        close(srcFd);
+    if (!detached)
+    {
+        LOG_DEBUG_SAF("%s: cannot detach %s: %s", __FUNCTION__, path.c_str(), strerror(err));
+        return false;
+    }
+    SAFWorkerPool::getInstance().submit([purgeDir]() { purgeDetached(purgeDir); }, TaskLane::BULK);
+    return true;
+}
+
+InternalRemove::InternalRemove(std::string path, std::shared_ptr<TransferJob> job, std::string purgeRoot)
+    : mPath(std::move(path)), mPurgeRoot(std::move(purgeRoot)), mStatus(NO_ERROR), mJob(std::move(job))
 {
     init();
 }
 
 void InternalRemove::init()
 {
-    try
+    if (!validateInternalPath(mPath))
     {
-        if (validateInternalPath(mPath))
-        {
-            fs::remove_all(mPath);
-            mStatus = SUCCESS;
-        }
-        else
-            mStatus = INVALID_PATH;
+        mStatus = INVALID_PATH;
+        return;
     }
-    catch(fs::filesystem_error& e)
+    if (mJob && !mJob->start())
     {
-        LOG_DEBUG_SAF("%s: %s", __FUNCTION__, e.what());
-        mStatus = PERMISSION_DENIED;
+        mStatus = OPERATION_CANCELLED;
+        return;
+    }
+    if (detachTree(mPath, mPurgeRoot))
+    {
+        mStatus = SUCCESS;
+        return;
     }
+    mStatus = removeTree(mPath, mJob);
 }
 
 int32_t InternalRemove::getStatus()
@@ -558,8 +1618,8 @@ int32_t InternalRemove::getStatus()
     return mStatus;
 }
 
-InternalMove::InternalMove(std::string srcPath, std::string destPath, bool overwrite)
-    : mSrcPath(std::move(srcPath)), mDestPath(std::move(destPath)), mStatus(NO_ERROR), mOverwrite(overwrite)
+InternalMove::InternalMove(std::string srcPath, std::string destPath, bool overwrite, std::shared_ptr<TransferJob> job)
+    : mSrcPath(std::move(srcPath)), mDestPath(std::move(destPath)), mStatus(NO_ERROR), mOverwrite(overwrite), mJob(std::move(job))
 {
     init();
 }
@@ -584,34 +1644,46 @@ void InternalMove::init()
             mStatus = FILE_ALREADY_EXISTS;
             return;
         }
+        if (mJob && !mJob->start())
+        {
+            mStatus = OPERATION_CANCELLED;
+            return;
+        }
+        // Within one filesystem the whole move is a single rename
+        struct stat srcStat;
+        struct stat destStat;
+        if ((stat(mSrcPath.c_str(), &srcStat) == 0) && (stat(mDestPath.c_str(), &destStat) == 0)
+            && (srcStat.st_dev == destStat.st_dev))
+        {
+            if (renameBeneath(mSrcPath, desPath, mOverwrite ? 0 : RENAME_NOREPLACE) == 0)
+            {
+                mStatus = SUCCESS;
+                return;
+            }
+            if (errno == EEXIST)
+            {
+                mStatus = FILE_ALREADY_EXISTS;
+                return;
+            }
+            // e.g. a non-empty directory is in the way; merge by copying
+            LOG_DEBUG_SAF("%s: rename failed (%d), copying instead", __FUNCTION__, errno);
+        }
         if (fs::is_directory(mSrcPath))
         {
             if (!fs::exists(desPath))
-                fs::create_directories(desPath);
+                createDirsBeneath(desPath);
             mDestPath = std::move(desPath);
         }
-        mSrcSize = FolderContent(mSrcPath).getSize();
-        mDestSize = FolderContent(mDestPath).getSize();
-        std::async(std::launch::async, [this]()
-            {
-                try
-                {
-                    auto copyOptions = fs::copy_options::recursive
-                               | fs::copy_options::skip_symlinks;
-                    if (this->mOverwrite)
-                        copyOptions |= fs::copy_options::overwrite_existing;
-                    else
-                        copyOptions |= fs::copy_options::skip_existing;
-                    fs::copy(this->mSrcPath, this->mDestPath, copyOptions);
-                    this->mStatus = SUCCESS;
-                }
-                catch(fs::filesystem_error& e)
-                {
-                    LOG_DEBUG_SAF("%s", e.what());
-                    this->mStatus = PERMISSION_DENIED;
-                }
-            });
-        fs::remove_all(mSrcPath);
+        TransferManifest manifest;
+        manifest.build(mSrcPath, mDestPath);
+        mCounters.plan(manifest);
+        if (mJob)
+            mJob->setTotal(mCounters.getTotalBytes(), mCounters.getTotalFiles());
+        // Each file's source goes as soon as its copy is verified, so a
+        // cancelled or failed move leaves every file in exactly one place
+        mStatus = copyTree(manifest, mOverwrite, mCounters, mJob, true);
+        if (mStatus == SUCCESS)
+            removeEmptyDirs(mSrcPath);
     }
     catch(fs::filesystem_error& e)
     {
@@ -622,14 +1694,9 @@ void InternalMove::init()
 
 int32_t InternalMove::getStatus()
 {
-    uint32_t size = FolderContent(mDestPath).getSize();
-    mDestSize = size;
-    uint32_t change = (mSrcSize - size + mDestSize);
-    if ((mStatus >= NO_ERROR) && (change > 0))
-        mStatus = int(change / mSrcSize * 100);
-    else if ((mStatus >= NO_ERROR) && (change == 0))
-        mStatus = SUCCESS;
-    return mStatus;
+    if (mStatus != NO_ERROR)
+        return mStatus;
+    return mCounters.getPercent();
 }
 
 InternalRename::InternalRename(std::string oldAbsPath, std::string newAbsPath)
@@ -653,7 +1720,8 @@ void InternalRename::init ()
             return;
         }
         mNewAbsPath = mOldAbsPath.substr(0, mOldAbsPath.rfind("/") + 1) + mNewAbsPath;
-        fs::rename(mOldAbsPath, mNewAbsPath);
+        if (renameBeneath(mOldAbsPath, mNewAbsPath, 0) < 0)
+            throw fs::filesystem_error("rename", mOldAbsPath, mNewAbsPath, std::error_code(errno, std::generic_category()));
         mStatus = SUCCESS;
     }
     catch(fs::filesystem_error& e)
@@ -680,7 +1748,7 @@ void InternalCreateDir::init ()
         mStatus = INVALID_PATH;
         if (validateInternalPath(mPath))
         {
-            fs::create_directories(mPath);
+            createDirsBeneath(mPath);
             mStatus = SUCCESS;
         }
     }
@@ -715,12 +1783,91 @@ SAFUtilityOperation& SAFUtilityOperation::getInstance()
     return obj;
 }
 
-std::unique_ptr<FolderContents> SAFUtilityOperation::getListFolderContents(std::string path)
+std::unique_ptr<FolderContents> SAFUtilityOperation::getListFolderContents(std::string path, ListOptions options)
 {
-    std::unique_ptr<FolderContents> obj = std::unique_ptr<FolderContents>( new FolderContents(std::move(path)));
+    std::unique_ptr<FolderContents> obj = std::unique_ptr<FolderContents>( new FolderContents(std::move(path), std::move(options)));
     return std::move(obj);
 }
 
+ListOptions SAFUtilityOperation::getListOptions(pbnjson::JValue params)
+{
+    ListOptions options;
+    options.mWithDirSize = params.hasKey("dirSize") && params["dirSize"].asBool();
+    std::string sortBy = params.hasKey("sortBy") ? params["sortBy"].asString() : std::string();
+    if (sortBy == "name")
+        options.mSortBy = SortKey::NAME;
+    else if (sortBy == "date")
+        options.mSortBy = SortKey::DATE;
+    else if (sortBy == "size")
+        options.mSortBy = SortKey::SIZE;
+    options.mDescending = params.hasKey("sortOrder") && (params["sortOrder"].asString() == "desc");
+    if (!params.hasKey("filter"))
+        return options;
+    pbnjson::JValue filter = params["filter"];
+    if (filter.hasKey("type"))
+        options.mType = filter["type"].asString();
+    if (filter.hasKey("name"))
+        options.mNamePattern = filter["name"].asString();
+    if (filter.hasKey("extensions") && filter["extensions"].isArray())
+    {
+        for (ssize_t i = 0; i < filter["extensions"].arraySize(); ++i)
+        {
+            std::string extension = filter["extensions"][i].asString();
+            if (!extension.empty() && (extension[0] == '.'))
+                extension.erase(0, 1);
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            options.mExtensions.push_back(std::move(extension));
+        }
+    }
+    return options;
+}
+
+FolderPage SAFUtilityOperation::getFolderPage(std::shared_ptr<RequestData> reqData, std::string path)
+{
+    FolderPage page = { NO_ERROR, path, 0, {}, std::string() };
+    int offset = 0;
+    int limit = -1;
+    reqData->params["offset"].asNumber<int>(offset);
+    reqData->params["limit"].asNumber<int>(limit);
+    std::string key = reqData->sessionId + "|" + reqData->params["storageType"].asString()
+        + "|" + reqData->params["driveId"].asString() + "|" + path;
+
+    std::shared_ptr<FolderContents> contents;
+    std::uint32_t start = 0;
+    if (reqData->params.hasKey("cursor"))
+    {
+        contents = ListingSnapshots::getInstance().resolve(key, reqData->params["cursor"].asString(), start);
+        if (!contents)
+        {
+            page.mStatus = INVALID_CURSOR;
+            return page;
+        }
+    }
+    else
+    {
+        ListOptions options = getListOptions(reqData->params);
+        if ((reqData->storageType == StorageType::INTERNAL) || (reqData->storageType == StorageType::USB))
+            contents = ListingCache::getInstance().get(path, options);
+        else
+            contents = getListFolderContents(std::move(path), std::move(options));
+        start = (offset > 0) ? (std::uint32_t)(offset - 1) : 0;
+    }
+    page.mStatus = contents->getStatus();
+    page.mFullPath = contents->getPath();
+    page.mTotalCount = contents->getTotalCount();
+    if (page.mStatus < 0)
+        return page;
+    std::uint32_t end = page.mTotalCount;
+    if ((limit >= 0) && (start + (std::uint32_t)limit < end))
+        end = start + (std::uint32_t)limit;
+    LOG_DEBUG_SAF("%s: start:%u, end: %u", __FUNCTION__, start, end);
+    // Only the returned window is stat'ed; totalCount comes from readdir alone
+    page.mEntries = contents->getContents(start, end);
+    if (end < page.mTotalCount)
+        page.mCursor = ListingSnapshots::getInstance().getCursor(key, contents, end);
+    return page;
+}
+
 std::unique_ptr<InternalSpaceInfo> SAFUtilityOperation::getProperties(std::string path)
 {
     if (path.empty())   path = "/tmp";
@@ -729,26 +1876,202 @@ std::unique_ptr<InternalSpaceInfo> SAFUtilityOperation::getProperties(std::strin
 }
 
 std::unique_ptr<InternalCopy> SAFUtilityOperation::copy(std::string srcPath,
-    std::string destPath, bool overwrite)
+    std::string destPath, bool overwrite, std::shared_ptr<TransferJob> job)
 {
-    std::unique_ptr<InternalCopy> obj = std::unique_ptr<InternalCopy>(new InternalCopy(std::move(srcPath), std::move(destPath), overwrite));
+    DirSizeCache::getInstance().invalidate(destPath);
+    std::unique_ptr<InternalCopy> obj = std::unique_ptr<InternalCopy>(new InternalCopy(std::move(srcPath), destPath, overwrite, std::move(job)));
+    VolumeInfoCache::getInstance().invalidate(destPath);
     return std::move(obj);
 }
 
-std::unique_ptr<InternalRemove> SAFUtilityOperation::remove(std::string path)
+std::unique_ptr<InternalRemove> SAFUtilityOperation::remove(std::string path,
+    std::shared_ptr<TransferJob> job, std::string purgeRoot)
 {
-    std::unique_ptr<InternalRemove> obj = std::unique_ptr<InternalRemove>(new InternalRemove(std::move(path)));
+    DirSizeCache::getInstance().invalidate(path);
+    std::unique_ptr<InternalRemove> obj = std::unique_ptr<InternalRemove>(new InternalRemove(path, std::move(job), std::move(purgeRoot)));
+    VolumeInfoCache::getInstance().invalidate(path);
     return std::move(obj);
 }
 
-std::unique_ptr<InternalMove> SAFUtilityOperation::move(std::string srcPath, std::string destPath, bool overwrite)
+// Trash layout under a storage root: files/<id> is the removed entry and
+// info/<id> holds the path it was removed from. Ids start with the time of
+// removal, so sorting them gives the oldest entries first.
+int32_t SAFUtilityOperation::moveToTrash(std::string path, std::string root, std::string& trashId)
+{
+    if (!::validateInternalPath(path) || !isUnderRoot(path, root))
+        return INVALID_PATH;
+    if (isServicePath(path, root))
+        return PERMISSION_DENIED;
+    std::string trashDir = root + "/" + SAF_TRASH_DIR_NAME;
+    DirSizeCache::getInstance().invalidate(path);
+    std::lock_guard<std::mutex> lock(mTrashMutex);
+    PathHandles& handles = PathHandles::getInstance();
+    std::string leaf;
+    int srcFd = handles.openParent(root, path, leaf);
+    int filesFd = (srcFd < 0) ? -1 : handles.makeDirs(root, trashDir + "/files", 0700);
+    int infoFd = (filesFd < 0) ? -1 : handles.makeDirs(root, trashDir + "/info", 0700);
+    int32_t status = (infoFd < 0) ? getRemoveStatus(errno) : SUCCESS;
+    if (status == SUCCESS)
+    {
+        trashId = getUniqueName();
+        // The info goes first: an info without its entry is only dropped by the
+        // next reclaim, an entry without its info could never be restored
+        std::string line = path + "\n";
+        int fd = openat(infoFd, trashId.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+        bool written = (fd >= 0) && (write(fd, line.data(), line.size()) == (ssize_t)line.size());
+        if (!written)
+            status = getRemoveStatus(errno);
+        if ((fd >= 0) && (close(fd) < 0) && (status == SUCCESS))
+            status = getRemoveStatus(errno);
+        if ((status == SUCCESS) && (renameat2(srcFd, leaf.c_str(), filesFd, trashId.c_str(), RENAME_NOREPLACE) < 0))
+            status = getRemoveStatus(errno);
+        if ((status != SUCCESS) && (fd >= 0))
+            unlinkat(infoFd, trashId.c_str(), 0);
+    }
+    for (int fd : { infoFd, filesFd, srcFd })
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+    if (status != SUCCESS)
+        return status;
+    SAFWorkerPool::getInstance().submit([this, root]() { reclaimTrash(root); }, TaskLane::BULK);
+    return SUCCESS;
+}
+
+// Puts a trashed entry back where it was removed from. Without an id the
+// newest entry removed from path is taken.
+int32_t SAFUtilityOperation::restoreFromTrash(std::string root, std::string trashId,
+    std::string path, std::string& restoredPath)
+{
+    std::string trashDir = root + "/" + SAF_TRASH_DIR_NAME;
+    std::lock_guard<std::mutex> lock(mTrashMutex);
+    if (trashId.empty())
+    {
+        std::error_code ec;
+        for (auto itr = fs::directory_iterator(trashDir + "/info", ec); !ec && (itr != fs::directory_iterator()); itr.increment(ec))
+        {
+            std::string id = itr->path().filename().string();
+            std::string origin;
+            std::ifstream info(itr->path());
+            if (std::getline(info, origin) && (origin == path) && (id > trashId))
+                trashId = std::move(id);
+        }
+    }
+    if (trashId.empty() || (trashId.find('/') != std::string::npos) || (trashId[0] == '.'))
+        return INVALID_PATH;
+    std::string infoPath = trashDir + "/info/" + trashId;
+    std::ifstream info(infoPath);
+    if (!std::getline(info, restoredPath))
+        return INVALID_PATH;
+    // The info file lives on the volume and may have been edited, so its
+    // path is trusted no further than what it names lexically
+    fs::path target = fs::path(restoredPath).lexically_normal();
+    for (const auto& part : target)
+    {
+        if (part == "..")
+            return INVALID_PATH;
+    }
+    restoredPath = target.string();
+    if (!restoredPath.empty() && (restoredPath.back() == '/'))
+        restoredPath.pop_back();
+    if (!isUnderRoot(restoredPath, root) || isServicePath(restoredPath, root))
+        return INVALID_PATH;
+
+    // Both ends are resolved beneath root, so a symlinked folder on the way
+    // cannot lead the entry, or a created folder, out of the volume
+    PathHandles& handles = PathHandles::getInstance();
+    int filesFd = handles.open(root, trashDir + "/files", O_PATH | O_DIRECTORY);
+    if (filesFd < 0)
+        return getRemoveStatus(errno);
+    std::string leaf;
+    int parentFd = handles.openParent(root, restoredPath, leaf);
+    if ((parentFd < 0) && (errno == ENOENT) && (faccessat(filesFd, trashId.c_str(), F_OK, AT_SYMLINK_NOFOLLOW) == 0))
+    {
+        // The folder it came from is gone too
+        parentFd = handles.openParent(root, restoredPath, leaf, true);
+    }
+    int ret = -1;
+    if (parentFd >= 0)
+    {
+        ret = renameat2(filesFd, trashId.c_str(), parentFd, leaf.c_str(), RENAME_NOREPLACE);
+        int err = errno;
+        close(parentFd);
+        errno = err;
+    }
+    int err = errno;
+    close(filesFd);
+    if (ret < 0)
+        return (err == EEXIST) ? FILE_ALREADY_EXISTS : getRemoveStatus(err);
+    unlinkBeneath(infoPath, 0);
+    DirSizeCache::getInstance().invalidate(restoredPath);
+    return SUCCESS;
+}
+
+// Detaches the whole trash with one rename; the purge runs in the background
+int32_t SAFUtilityOperation::emptyTrash(std::string root)
+{
+    std::string trashDir = root + "/" + SAF_TRASH_DIR_NAME;
+    std::lock_guard<std::mutex> lock(mTrashMutex);
+    if (access(trashDir.c_str(), F_OK) < 0)
+        return (errno == ENOENT) ? SUCCESS : getRemoveStatus(errno);
+    if (!detachTree(trashDir, root))
+        return getRemoveStatus(errno);
+    return SUCCESS;
+}
+
+// Runs on a bulk worker after every trash. Entries past the retention time
+// go, and while the volume is short of free space the oldest go as well.
+// Each is detached under the lock and purged at idle I/O priority.
+void SAFUtilityOperation::reclaimTrash(std::string root)
+{
+    std::string trashDir = root + "/" + SAF_TRASH_DIR_NAME;
+    std::vector<std::string> ids;
+    std::error_code ec;
+    for (auto itr = fs::directory_iterator(trashDir + "/files", ec); !ec && (itr != fs::directory_iterator()); itr.increment(ec))
+        ids.push_back(itr->path().filename().string());
+    std::sort(ids.begin(), ids.end());
+    long long cutoff = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() - SAF_TRASH_RETENTION_SEC * 1000LL;
+    bool reclaimed = false;
+    for (auto& id : ids)
+    {
+        struct statvfs vfs;
+        bool lowSpace = (statvfs(root.c_str(), &vfs) == 0) && (vfs.f_blocks > 0)
+            && ((vfs.f_bavail * 100 / vfs.f_blocks) < SAF_TRASH_MIN_FREE_PERCENT);
+        // Entries without a time prefix are not ours; they are left alone
+        long long removedAt = strtoll(id.c_str(), NULL, 10);
+        if ((removedAt <= 0) || (!lowSpace && (removedAt >= cutoff)))
+            break;
+        {
+            std::lock_guard<std::mutex> lock(mTrashMutex);
+            std::string infoPath = trashDir + "/info/" + id;
+            if (detachTree(trashDir + "/files/" + id, root))
+                reclaimed = true;
+            unlinkBeneath(infoPath, 0);
+        }
+        // Freeing space takes the purge; wait for it before judging again
+        if (lowSpace)
+            purgeDetached(root + "/" + SAF_PURGE_DIR_NAME);
+    }
+    if (reclaimed)
+        LOG_DEBUG_SAF("%s: trash of %s reclaimed", __FUNCTION__, root.c_str());
+}
+
+std::unique_ptr<InternalMove> SAFUtilityOperation::move(std::string srcPath, std::string destPath, bool overwrite, std::shared_ptr<TransferJob> job)
 {
-    std::unique_ptr<InternalMove> obj = std::unique_ptr<InternalMove>(new InternalMove(std::move(srcPath), std::move(destPath), overwrite));
+    DirSizeCache::getInstance().invalidate(srcPath);
+    DirSizeCache::getInstance().invalidate(destPath);
+    std::unique_ptr<InternalMove> obj = std::unique_ptr<InternalMove>(new InternalMove(srcPath, destPath, overwrite, std::move(job)));
+    VolumeInfoCache::getInstance().invalidate(srcPath);
+    VolumeInfoCache::getInstance().invalidate(destPath);
     return std::move(obj);
 }
 
 std::unique_ptr<InternalRename> SAFUtilityOperation::rename(std::string srcPath, std::string destPath)
 {
+    DirSizeCache::getInstance().invalidate(srcPath);
+    DirSizeCache::getInstance().invalidate(destPath);
     std::unique_ptr<InternalRename> obj = std::unique_ptr<InternalRename>(new InternalRename(std::move(srcPath), std::move(destPath)));
     return std::move(obj);
 }
@@ -12,11 +12,17 @@
 
 #ifndef _INTERNAL_OPERATION_HANDLER_H_
 #define _INTERNAL_OPERATION_HANDLER_H_
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <map>
 #include <vector>
 #include <string>
 #include <memory>
+#include <mutex>
 #include <stdint.h>
+#include <dirent.h>
+#include <sys/types.h>
 #include "SAFErrors.h"
 #include "SA_Common.h"
 
@@ -29,60 +35,218 @@ enum InternalOperErrors
 	INVALID_DEST_PATH = -4,
 	FILE_ALREADY_EXISTS = -5,
 	PERMISSION_DENIED = -6,
+	OPERATION_CANCELLED = -7,
+	INVALID_CURSOR = -8,
+	FILE_TOO_LARGE = -9,
 	SUCCESS = 100
 };
+class TransferJob;
+
 int getInternalErrorCode(int errorCode);
 bool validateInternalPath(std::string&);
 
+enum class SortKey
+{
+    UNSORTED, NAME, DATE, SIZE
+};
+
+// Everything a list request asks for besides the folder itself
+struct ListOptions
+{
+    bool mWithDirSize = false;
+    SortKey mSortBy = SortKey::UNSORTED;
+    bool mDescending = false;
+    std::string mType;
+    std::vector<std::string> mExtensions;
+    std::string mNamePattern;
+};
+
+// One returned entry, copied out of the listing it came from
 class FolderContent
 {
 private:
     std::string mName;
     std::string mPath;
     std::string mType;
-    std::string mModTime;
+    bool mIsDirectory;
+    time_t mModTime;
     uintmax_t mSize;
-
-    void init();
-    std::string getFileType(std::string);
-    std::string getLastWrite(std::string);
-    uintmax_t getFileSize(std::string);
-    std::string getModTime();
+    uintmax_t mFileCount;
+    bool mHasSize;
 
 public:
-    FolderContent(std::string);
+    FolderContent(std::string path, std::string name, std::string type, bool isDirectory,
+        time_t modTime, bool hasSize, uintmax_t size, uintmax_t fileCount);
+    bool isDirectory() { return mIsDirectory; }
+    time_t getModTimeValue() { return mModTime; }
     std::string getName() { return mName; }
     std::string getPath() { return mPath; }
     std::string getType() { return mType; }
+    // Directories only carry a size when it was asked for
+    bool hasSize() { return mHasSize; }
     uintmax_t getSize() { return mSize; }
-    std::string getLastModTime() { return mModTime; }
+    // Files under a directory, set along with its size
+    uintmax_t getFileCount() { return mFileCount; }
+    std::string getLastModTime();
 };
 
+// The entries of one folder as parallel arrays: every name lives in a
+// single pool and each attribute in its own array, so a folder of any size
+// takes a few growing allocations and sorting touches only the arrays it
+// compares. Entries never move; mOrder is the filtered, sorted view.
 class FolderContents
 {
 private:
+    enum EntryType : unsigned char
+    {
+        TYPE_UNKNOWN, TYPE_REGULAR, TYPE_DIRECTORY, TYPE_LINK
+    };
+    enum EntryFlags : unsigned char
+    {
+        ENTRY_LOADED = 0x01, ENTRY_HAS_SIZE = 0x02
+    };
     std::string mFullPath;
+    ListOptions mOptions;
     std::uint32_t mTotalCount;
-    std::vector<std::shared_ptr<FolderContent>> mContents;
+    std::uint32_t mSortedCount;
+    std::string mNamePool;
+    std::vector<std::uint32_t> mNameOffsets;
+    std::vector<unsigned char> mDirentTypes;
+    std::vector<unsigned char> mTypes;
+    std::vector<unsigned char> mFlags;
+    std::vector<time_t> mModTimes;
+    std::vector<uintmax_t> mSizes;
+    std::vector<uintmax_t> mFileCounts;
+    std::vector<std::uint32_t> mOrder;
+    std::mutex mMutex;
 	int32_t mStatus;
     void init();
+    const char *getName(std::uint32_t index) { return mNamePool.data() + mNameOffsets[index]; }
+    bool isDirectory(std::uint32_t index)
+    {
+        return (mDirentTypes[index] == DT_DIR) || (mTypes[index] == TYPE_DIRECTORY);
+    }
+    void append(const char *name, unsigned char direntType);
+    void dropLast();
+    // Fills in type, size and time with at most one statx on the entry;
+    // directories are only stat'ed when their size or time is needed
+    void load(std::uint32_t index, int dirFd, bool withTime = false);
+    // The type from d_type where that is conclusive, else from the inode
+    EntryType resolveType(std::uint32_t index, int dirFd);
+    bool matches(std::uint32_t index, int dirFd);
+    void sortUpTo(std::uint32_t end, int dirFd);
 public:
-    FolderContents(std::string);
+    FolderContents(std::string, ListOptions options = ListOptions());
 	int32_t getStatus() { return mStatus; }
     std::string getPath() { return mFullPath; }
     std::uint32_t getTotalCount() { return mTotalCount; }
-    std::vector<std::shared_ptr<FolderContent>> getContents() { return mContents; }
+    std::size_t getMemoryUsage();
+    // Loads the attributes of entries [start, end) and returns them
+    std::vector<FolderContent> getContents(std::uint32_t start, std::uint32_t end);
+};
+
+// One page of a list request. mCursor is only set while entries remain.
+struct FolderPage
+{
+    int32_t mStatus;
+    std::string mFullPath;
+    std::uint32_t mTotalCount;
+    std::vector<FolderContent> mEntries;
+    std::string mCursor;
+};
+
+// Enumerated folders kept for a short while, so that the pages behind a
+// cursor come from one consistent entry order without re-reading the
+// directory. Snapshots are bound to the session, provider, drive and path
+// that created them and bounded in count, total entries and age.
+class ListingSnapshots
+{
+private:
+    struct Snapshot
+    {
+        std::string mKey;
+        std::shared_ptr<FolderContents> mContents;
+        std::chrono::steady_clock::time_point mLastUsed;
+    };
+    std::mutex mMutex;
+    std::map<std::uint64_t, Snapshot> mSnapshots;
+    std::uint64_t mNextId;
+    std::size_t mTotalEntries;
+
+    ListingSnapshots() : mNextId(0), mTotalEntries(0) {}
+    void evict(std::chrono::steady_clock::time_point now, std::size_t incoming);
+public:
+    static ListingSnapshots& getInstance();
+    std::string getCursor(const std::string& key, std::shared_ptr<FolderContents> contents, std::uint32_t position);
+    std::shared_ptr<FolderContents> resolve(const std::string& key, const std::string& cursor, std::uint32_t& position);
+};
+
+// Recursive directory sizes, computed only on request and kept for a short
+// while so that paging through a folder does not walk its subtrees again.
+// Operations that change a tree drop the cached sizes of every directory
+// above and below the paths they touched.
+class DirSizeCache
+{
+private:
+    struct Entry
+    {
+        uintmax_t mSize;
+        uintmax_t mFiles;
+        std::chrono::steady_clock::time_point mTime;
+    };
+    std::mutex mMutex;
+    std::map<std::string, Entry> mEntries;
+
+    DirSizeCache() {}
+    uintmax_t computeSize(const std::string&, uintmax_t&);
+public:
+    static DirSizeCache& getInstance();
+    uintmax_t getSize(const std::string&);
+    // Answered from the SizeIndex when the folder's root is indexed
+    void getTotals(const std::string&, uintmax_t&, uintmax_t&);
+    void invalidate(const std::string&);
+};
+
+// Space of one volume, in bytes
+struct VolumeInfo
+{
+    uint64_t mCapacity;
+    uint64_t mFree;
+    uint64_t mAvail;
+};
+
+// statvfs results per device, kept for a few seconds so that clients polling
+// getProperties on every drive do not turn each poll into a statfs. Copies,
+// moves and removes we perform drop the entry of the volume they changed.
+class VolumeInfoCache
+{
+private:
+    struct Entry
+    {
+        VolumeInfo mInfo;
+        std::chrono::steady_clock::time_point mTime;
+    };
+    std::mutex mMutex;
+    std::map<dev_t, Entry> mEntries;
+
+    VolumeInfoCache() {}
+public:
+    static VolumeInfoCache& getInstance();
+    // fd is any descriptor on the volume, O_PATH included
+    bool get(int fd, dev_t dev, VolumeInfo&);
+    void invalidate(const std::string&);
 };
 
 class InternalSpaceInfo
 {
 private:
     std::string mPath;
-    std::uint32_t mCapacity;
-    std::uint32_t mFreeSpace;
-    std::uint32_t mAvailSpace;
+    VolumeInfo mVolume;
     bool mIsWritable;
     bool mIsDeletable;
+    bool mHasTotals;
+    uint64_t mTotalBytes;
+    uint64_t mFileCount;
 	int32_t mStatus;
     void init();
 public:
@@ -90,24 +254,76 @@ public:
     std::uint32_t getCapacityMB();
     std::uint32_t getFreeSpaceMB();
     std::uint32_t getAvailSpaceMB();
+    uint64_t getCapacityBytes() { return mVolume.mCapacity; }
+    uint64_t getFreeSpaceBytes() { return mVolume.mFree; }
+    uint64_t getAvailSpaceBytes() { return mVolume.mAvail; }
     bool getIsWritable();
     bool getIsDeletable();
+    // Recursive totals, only known once the folder's root is indexed
+    bool hasTotals() { return mHasTotals; }
+    uint64_t getTotalBytes() { return mTotalBytes; }
+    uint64_t getFileCount() { return mFileCount; }
 	std::string getLastModTime();
 	int32_t getStatus();
 };
 
+// Everything one copy has to do, collected in a single pass over the source:
+// the directories to create up front and the files to copy with their sizes.
+class TransferManifest
+{
+public:
+    struct Entry
+    {
+        std::string mSrcPath;
+        std::string mDestPath;
+        uint64_t mSize;
+    };
+private:
+    std::vector<std::string> mDirs;
+    std::vector<Entry> mFiles;
+    uint64_t mTotalBytes;
+public:
+    TransferManifest() : mTotalBytes(0) {}
+    void build(const std::string&, const std::string&);
+    const std::vector<std::string>& getDirs() { return mDirs; }
+    const std::vector<Entry>& getFiles() { return mFiles; }
+    uint64_t getTotalBytes() { return mTotalBytes; }
+};
+
+// Byte and file counters kept by the copy engine. The totals come from the
+// manifest, so reading progress is O(1).
+class TransferCounters
+{
+private:
+    uint64_t mTotalBytes;
+    uint64_t mTotalFiles;
+    std::atomic<uint64_t> mBytesDone;
+    std::atomic<uint64_t> mFilesDone;
+public:
+    TransferCounters();
+    void plan(TransferManifest&);
+    void add(uint64_t bytes, uint64_t files);
+    uint64_t getTotalBytes() { return mTotalBytes; }
+    uint64_t getTotalFiles() { return mTotalFiles; }
+    uint64_t getBytesDone() { return mBytesDone; }
+    uint64_t getFilesDone() { return mFilesDone; }
+    int32_t getPercent();
+};
+
 class InternalCopy
 {
 private:
     std::string mSrcPath;
     std::string mDestPath;
-    uint32_t mSrcSize;
-    uint32_t mDestSize;
+    TransferCounters mCounters;
     int32_t mStatus;
 	bool mOverwrite;
+    std::shared_ptr<TransferJob> mJob;
     void init();
 public:
-    InternalCopy(std::string, std::string, bool);
+    InternalCopy(std::string, std::string, bool, std::shared_ptr<TransferJob> job = nullptr);
+    uint64_t getBytesDone() { return mCounters.getBytesDone(); }
+    uint64_t getTotalBytes() { return mCounters.getTotalBytes(); }
     std::int32_t getStatus();
 };
 
@@ -115,10 +331,14 @@ class InternalRemove
 {
 private:
     std::string mPath;
+    std::string mPurgeRoot;
     int32_t mStatus;
+    std::shared_ptr<TransferJob> mJob;
     void init();
 public:
-    InternalRemove(std::string);
+    // With a purge root the tree is detached under it and deleted in the
+    // background, so the remove returns without waiting for the unlinks
+    InternalRemove(std::string, std::shared_ptr<TransferJob> job = nullptr, std::string purgeRoot = "");
     int32_t getStatus();
 };
 
@@ -127,13 +347,15 @@ class InternalMove
 private:
     std::string mSrcPath;
     std::string mDestPath;
-    uint32_t mSrcSize;
-    uint32_t mDestSize;
+    TransferCounters mCounters;
     int32_t mStatus;
 	bool mOverwrite;
+    std::shared_ptr<TransferJob> mJob;
     void init();
 public:
-    InternalMove(std::string, std::string, bool);
+    InternalMove(std::string, std::string, bool, std::shared_ptr<TransferJob> job = nullptr);
+    uint64_t getBytesDone() { return mCounters.getBytesDone(); }
+    uint64_t getTotalBytes() { return mCounters.getTotalBytes(); }
     int32_t getStatus();
 };
 
@@ -166,19 +388,32 @@ class SAFUtilityOperation
 private:
     SAFUtilityOperation();
     std::map<std::string,std::string> mSambaDrivePathMap;
+    std::mutex mDriveMapMutex;
+    std::mutex mTrashMutex;
+    std::mutex mInternalPathMutex;
+    std::map<std::string, std::string> mInternalPaths;
+    void reclaimTrash(std::string);
 public:
     static SAFUtilityOperation& getInstance();
-    std::unique_ptr<FolderContents> getListFolderContents(std::string);
+    std::unique_ptr<FolderContents> getListFolderContents(std::string, ListOptions options = ListOptions());
+    ListOptions getListOptions(pbnjson::JValue);
+    FolderPage getFolderPage(std::shared_ptr<RequestData>, std::string);
     std::unique_ptr<InternalSpaceInfo> getProperties(std::string path = std::string());
-    std::unique_ptr<InternalCopy> copy(std::string, std::string, bool);
-    std::unique_ptr<InternalRemove> remove(std::string);
-    std::unique_ptr<InternalMove> move(std::string, std::string, bool);
+    std::unique_ptr<InternalCopy> copy(std::string, std::string, bool, std::shared_ptr<TransferJob> job = nullptr);
+    std::unique_ptr<InternalRemove> remove(std::string, std::shared_ptr<TransferJob> job = nullptr,
+        std::string purgeRoot = "");
+    std::unique_ptr<InternalMove> move(std::string, std::string, bool, std::shared_ptr<TransferJob> job = nullptr);
 	std::unique_ptr<InternalRename> rename(std::string, std::string);
+    // Trash kept per storage root; moving in and out is a rename each way
+    int32_t moveToTrash(std::string, std::string, std::string&);
+    int32_t restoreFromTrash(std::string, std::string, std::string, std::string&);
+    int32_t emptyTrash(std::string);
     void setDriveDetails(const std::string&, std::map<std::string,std::string>&);
     bool validateInternalPath(std::string&, std::string&);
     bool validateSambaPath(std::string&, std::string&);
     bool validateInterProviderOperation(std::shared_ptr<RequestData>);
     std::string getInternalPath(std::string);
+    bool createDirectories(const std::string&);
     void setPathPerm(std::string, std::string);
 };
 
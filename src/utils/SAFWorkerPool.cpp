@@ -0,0 +1,159 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#include <exception>
+#include "SAFLog.h"
+#include "SAFWorkerPool.h"
+
+#define SAF_MIN_WORKER_COUNT 2
+#define SAF_INTERACTIVE_RESERVE_DIVISOR 4
+
+static thread_local int tWorkerIndex = -1;
+
+SAFWorkerPool::SAFWorkerPool() : mNextQueue(0), mPending(0), mActiveBulk(0)
+{
+    size_t count = std::thread::hardware_concurrency();
+    if (count < SAF_MIN_WORKER_COUNT)
+        count = SAF_MIN_WORKER_COUNT;
+    size_t reserved = count / SAF_INTERACTIVE_RESERVE_DIVISOR;
+    mMaxBulk = count - ((reserved > 0) ? reserved : 1);
+    for (size_t i = 0; i < count; ++i)
+        mQueues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    for (size_t i = 0; i < count; ++i)
+        mWorkers.push_back(std::thread(std::bind(&SAFWorkerPool::workerLoop, this, i)));
+    LOG_DEBUG_SAF("%s: started %d workers, %d for bulk", __FUNCTION__, (int)count, (int)mMaxBulk);
+}
+
+SAFWorkerPool& SAFWorkerPool::getInstance()
+{
+    // Intentionally never destroyed: workers may still be busy with a
+    // transfer when the service exits and must not outlive their queues.
+    static SAFWorkerPool *obj = new SAFWorkerPool();
+    return *obj;
+}
+
+TaskLane SAFWorkerPool::getLane(std::shared_ptr<RequestData> request)
+{
+    switch(request->methodType)
+    {
+        case MethodType::REMOVE_METHOD:
+            // A remove into the trash is one rename, so it does not queue behind copies
+            if (request->params.hasKey("trash") && request->params["trash"].asBool())
+                return TaskLane::INTERACTIVE;
+            return TaskLane::BULK;
+        case MethodType::COPY_METHOD:
+        case MethodType::MOVE_METHOD:
+            return TaskLane::BULK;
+        default:
+            return TaskLane::INTERACTIVE;
+    }
+}
+
+void SAFWorkerPool::submit(Task task, TaskLane lane)
+{
+    if (lane == TaskLane::BULK)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mBulkTasks.push_back(std::move(task));
+        }
+        mCondVar.notify_one();
+        return;
+    }
+    size_t index = (tWorkerIndex >= 0) ? (size_t)tWorkerIndex
+        : (mNextQueue.fetch_add(1, std::memory_order_relaxed) % mQueues.size());
+    {
+        std::lock_guard<std::mutex> lock(mQueues[index]->mMutex);
+        mQueues[index]->mTasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mPending;
+    }
+    mCondVar.notify_one();
+}
+
+bool SAFWorkerPool::popLocal(size_t index, Task& task)
+{
+    std::lock_guard<std::mutex> lock(mQueues[index]->mMutex);
+    if (mQueues[index]->mTasks.empty())
+        return false;
+    task = std::move(mQueues[index]->mTasks.back());
+    mQueues[index]->mTasks.pop_back();
+    return true;
+}
+
+bool SAFWorkerPool::steal(size_t index, Task& task)
+{
+    for (size_t i = 1; i < mQueues.size(); ++i)
+    {
+        WorkerQueue& victim = *mQueues[(index + i) % mQueues.size()];
+        std::lock_guard<std::mutex> lock(victim.mMutex);
+        if (victim.mTasks.empty())
+            continue;
+        task = std::move(victim.mTasks.front());
+        victim.mTasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void SAFWorkerPool::workerLoop(size_t index)
+{
+    tWorkerIndex = (int)index;
+    while (true)
+    {
+        Task task;
+        bool isBulk = false;
+        {
+            // Interactive work always wins; a bulk task is only admitted while
+            // fewer than mMaxBulk workers are busy with bulk work.
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondVar.wait(lock, [this] {
+                return ((mPending > 0) || (!mBulkTasks.empty() && (mActiveBulk < mMaxBulk)));
+            });
+            if (mPending > 0)
+            {
+                // Claim one queued task; it is guaranteed to be in some deque.
+                --mPending;
+            }
+            else
+            {
+                task = std::move(mBulkTasks.front());
+                mBulkTasks.pop_front();
+                ++mActiveBulk;
+                isBulk = true;
+            }
+        }
+        if (!isBulk)
+        {
+            while (!popLocal(index, task) && !steal(index, task))
+                std::this_thread::yield();
+        }
+        try
+        {
+            task();
+        }
+        catch (std::exception& e)
+        {
+            LOG_DEBUG_SAF("%s: task failed: %s", __FUNCTION__, e.what());
+        }
+        if (isBulk)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                --mActiveBulk;
+            }
+            mCondVar.notify_one();
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#ifndef _SAF_WORKER_POOL_H_
+#define _SAF_WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SA_Common.h"
+
+enum class TaskLane
+{
+    INTERACTIVE, BULK
+};
+
+/*
+ * Service wide executor shared by all document providers.
+ * A fixed set of workers (one per core, at least two) each own a deque;
+ * a worker pops its own deque LIFO and steals FIFO from the others when idle.
+ * Bulk tasks (tree copy/move/remove) wait in a separate FIFO lane and may
+ * never occupy the workers reserved for interactive metadata requests.
+ */
+class SAFWorkerPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    static SAFWorkerPool& getInstance();
+    static TaskLane getLane(std::shared_ptr<RequestData> request);
+    void submit(Task task, TaskLane lane = TaskLane::INTERACTIVE);
+    size_t getWorkerCount() { return mWorkers.size(); }
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mMutex;
+        std::deque<Task> mTasks;
+    };
+
+    SAFWorkerPool();
+    SAFWorkerPool(const SAFWorkerPool&) = delete;
+    SAFWorkerPool& operator=(const SAFWorkerPool&) = delete;
+    void workerLoop(size_t index);
+    bool popLocal(size_t index, Task& task);
+    bool steal(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> mQueues;
+    std::vector<std::thread> mWorkers;
+    std::mutex mMutex;
+    std::condition_variable mCondVar;
+    std::deque<Task> mBulkTasks;
+    std::atomic<size_t> mNextQueue;
+    size_t mPending;
+    size_t mActiveBulk;
+    size_t mMaxBulk;
+};
+
+#endif /* _SAF_WORKER_POOL_H_ */
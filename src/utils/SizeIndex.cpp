@@ -0,0 +1,524 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "SAFLog.h"
+#include "SAFWorkerPool.h"
+#include "SizeIndex.h"
+
+#define SAF_INDEX_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+    | IN_CLOSE_WRITE | IN_ONLYDIR)
+#define SAF_INDEX_MAX_STREAMS 4
+#define SAF_CIFS_MAGIC 0xFF534D42
+#define SAF_SMB2_MAGIC 0xFE534D42
+#define SAF_SMB_MAGIC 0x517B
+#define SAF_NFS_MAGIC 0x6969
+
+static std::string getParent(const std::string& path)
+{
+    size_t pos = path.rfind('/');
+    return (pos == 0) ? std::string("/") : path.substr(0, pos);
+}
+
+static std::string getStateString(IndexState state)
+{
+    switch(state)
+    {
+        case IndexState::BUILDING:  return "building";
+        case IndexState::READY:     return "ready";
+        case IndexState::FAILED:    return "failed";
+    }
+    return "unknown";
+}
+
+SizeIndex::SizeIndex()
+{
+    mInotifyFd = inotify_init1(IN_CLOEXEC);
+    if (mInotifyFd < 0)
+    {
+        LOG_DEBUG_SAF("%s: inotify unavailable (%s), sizes are not indexed", __FUNCTION__, strerror(errno));
+        return;
+    }
+    std::thread(&SizeIndex::eventLoop, this).detach();
+}
+
+SizeIndex& SizeIndex::getInstance()
+{
+    // Never destroyed: the event thread and any build outlive main()
+    static SizeIndex *obj = new SizeIndex();
+    return *obj;
+}
+
+void SizeIndex::addRoot(const std::string& path)
+{
+    if ((mInotifyFd < 0) || path.empty())
+        return;
+    std::string root = std::filesystem::path(path).lexically_normal().string();
+    if ((root.size() > 1) && (root.back() == '/'))
+        root.pop_back();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!findRoot(root).empty())
+            return;
+    }
+    // inotify only reports changes made through this kernel
+    struct statfs fsInfo;
+    if (statfs(root.c_str(), &fsInfo) < 0)
+        return;
+    unsigned long fsType = (unsigned long)fsInfo.f_type;
+    if ((fsType == SAF_CIFS_MAGIC) || (fsType == SAF_SMB2_MAGIC)
+        || (fsType == SAF_SMB_MAGIC) || (fsType == SAF_NFS_MAGIC))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!findRoot(root).empty())
+            return;
+        mRoots[root] = { IndexState::BUILDING, {} };
+    }
+    LOG_DEBUG_SAF("%s: indexing %s", __FUNCTION__, root.c_str());
+    std::thread(&SizeIndex::buildRoot, this, root).detach();
+}
+
+bool SizeIndex::getTotals(const std::string& path, uint64_t& bytes, uint64_t& files)
+{
+    std::string dir = std::filesystem::path(path).lexically_normal().string();
+    if ((dir.size() > 1) && (dir.back() == '/'))
+        dir.pop_back();
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::string root = findRoot(dir);
+    if (root.empty() || (mRoots[root].mState != IndexState::READY))
+        return false;
+    auto itr = mDirs.find(dir);
+    if (itr == mDirs.end())
+        return false;
+    bytes = itr->second.mTotalBytes;
+    files = itr->second.mTotalFiles;
+    return true;
+}
+
+pbnjson::JValue SizeIndex::toJson()
+{
+    pbnjson::JValue rootsArr = pbnjson::Array();
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& root : mRoots)
+    {
+        pbnjson::JValue rootObj = pbnjson::Object();
+        rootObj.put("path", root.first);
+        rootObj.put("state", getStateString(root.second.mState));
+        auto itr = mDirs.find(root.first);
+        if ((root.second.mState == IndexState::READY) && (itr != mDirs.end()))
+        {
+            std::string prefix = root.first + "/";
+            int64_t dirs = std::count_if(mDirs.begin(), mDirs.end(), [&prefix](const DirMap::value_type& dir)
+                { return (dir.first.compare(0, prefix.size(), prefix) == 0); });
+            rootObj.put("directories", dirs + 1);
+            rootObj.put("totalBytes", (int64_t)itr->second.mTotalBytes);
+            rootObj.put("totalFiles", (int64_t)itr->second.mTotalFiles);
+        }
+        rootsArr.append(rootObj);
+    }
+    return rootsArr;
+}
+
+// Reads one folder: the bytes and count of the regular files directly in
+// it, the names of its subfolders, and a watch so later changes show up.
+// Hidden entries are skipped, as listings skip them.
+bool SizeIndex::scanDir(const std::string& path, DirNode& node)
+{
+    int wd = inotify_add_watch(mInotifyFd, path.c_str(), SAF_INDEX_WATCH_MASK);
+    if (wd < 0)
+    {
+        LOG_DEBUG_SAF("%s: cannot watch %s: %s", __FUNCTION__, path.c_str(), strerror(errno));
+        return (errno != ENOSPC);
+    }
+    node.mWd = wd;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWatches[wd] = path;
+    }
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return true;
+    while (struct dirent *entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        unsigned char type = entry->d_type;
+        struct stat st;
+        bool known = false;
+        if ((type == DT_REG) || (type == DT_UNKNOWN))
+        {
+            known = (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0);
+            if (known && (type == DT_UNKNOWN))
+                type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+        }
+        if (type == DT_DIR)
+        {
+            node.mChildren.insert(entry->d_name);
+        }
+        else if ((type == DT_REG) && known)
+        {
+            node.mOwnBytes += st.st_size;
+            ++node.mOwnFiles;
+        }
+    }
+    closedir(dir);
+    return true;
+}
+
+// Indexes a whole subtree into dirs with its totals filled in; false when
+// the inotify watch limit was hit.
+bool SizeIndex::scanTree(const std::string& path, DirMap& dirs)
+{
+    std::vector<std::string> order;
+    std::vector<std::string> pending = { path };
+    while (!pending.empty())
+    {
+        std::string dirPath = std::move(pending.back());
+        pending.pop_back();
+        DirNode& node = dirs[dirPath];
+        if (!scanDir(dirPath, node))
+            return false;
+        for (auto& child : node.mChildren)
+            pending.push_back(dirPath + "/" + child);
+        order.push_back(std::move(dirPath));
+    }
+    // Children are always found after their parent, so walking the discovery
+    // order backwards totals every folder after all of its subfolders
+    for (auto itr = order.rbegin(); itr != order.rend(); ++itr)
+    {
+        DirNode& node = dirs[*itr];
+        node.mTotalBytes += node.mOwnBytes;
+        node.mTotalFiles += node.mOwnFiles;
+        if (*itr == path)
+            continue;
+        DirNode& parent = dirs[getParent(*itr)];
+        parent.mTotalBytes += node.mTotalBytes;
+        parent.mTotalFiles += node.mTotalFiles;
+    }
+    return true;
+}
+
+struct ParallelScanState
+{
+    std::mutex mMutex;
+    std::condition_variable mCondVar;
+    std::atomic<size_t> mNext{0};
+    std::atomic<bool> mFailed{false};
+    size_t mActive = 0;
+    bool mClosed = false;
+};
+
+void SizeIndex::buildRoot(std::string root)
+{
+    DirMap rootDirs;
+    DirNode& rootNode = rootDirs[root];
+    bool failed = !scanDir(root, rootNode);
+    std::vector<std::string> tops;
+    for (auto& child : rootNode.mChildren)
+        tops.push_back(root + "/" + child);
+
+    // Top-level folders are scanned on several bulk workers; the builder
+    // scans too, so the index completes even when none of them is free
+    auto state = std::make_shared<ParallelScanState>();
+    std::mutex resultMutex;
+    DirMap result;
+    auto runScan = [this, state, &tops, &resultMutex, &result]()
+        {
+            size_t index;
+            while (!state->mFailed && ((index = state->mNext++) < tops.size()))
+            {
+                DirMap dirs;
+                if (!scanTree(tops[index], dirs))
+                    state->mFailed = true;
+                std::lock_guard<std::mutex> lock(resultMutex);
+                result.merge(dirs);
+            }
+        };
+    size_t streams = std::min<size_t>(SAF_INDEX_MAX_STREAMS, SAFWorkerPool::getInstance().getWorkerCount());
+    streams = failed ? 0 : std::min(streams, tops.size());
+    for (size_t i = 1; i < streams; ++i)
+    {
+        SAFWorkerPool::getInstance().submit([state, runScan]()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(state->mMutex);
+                    if (state->mClosed)
+                        return;
+                    ++state->mActive;
+                }
+                runScan();
+                {
+                    std::lock_guard<std::mutex> lock(state->mMutex);
+                    --state->mActive;
+                }
+                state->mCondVar.notify_all();
+            }, TaskLane::BULK);
+    }
+    if (!failed)
+        runScan();
+    {
+        std::unique_lock<std::mutex> lock(state->mMutex);
+        state->mClosed = true;
+        state->mCondVar.wait(lock, [&state] { return (state->mActive == 0); });
+    }
+    failed = failed || state->mFailed;
+    result.merge(rootDirs);
+    DirNode& node = result[root];
+    node.mTotalBytes = node.mOwnBytes;
+    node.mTotalFiles = node.mOwnFiles;
+    for (auto& top : tops)
+    {
+        node.mTotalBytes += result[top].mTotalBytes;
+        node.mTotalFiles += result[top].mTotalFiles;
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto rootItr = mRoots.find(root);
+    if (failed || (rootItr == mRoots.end()))
+    {
+        for (auto& dir : result)
+            unwatch(dir.first, dir.second.mWd);
+        if (rootItr != mRoots.end())
+            rootItr->second.mState = IndexState::FAILED;
+        LOG_DEBUG_SAF("%s: %s not indexed", __FUNCTION__, root.c_str());
+        return;
+    }
+    mDirs.merge(result);
+    // Folders that changed while the scan ran are re-read before the root
+    // is declared ready; new events go to the event loop after that
+    while (!rootItr->second.mDirty.empty())
+    {
+        std::set<std::string> dirty = std::move(rootItr->second.mDirty);
+        rootItr->second.mDirty.clear();
+        lock.unlock();
+        for (auto& dir : dirty)
+            syncDir(dir);
+        lock.lock();
+        rootItr = mRoots.find(root);
+        if (rootItr == mRoots.end())
+            return;
+    }
+    rootItr->second.mState = IndexState::READY;
+    LOG_DEBUG_SAF("%s: %s ready", __FUNCTION__, root.c_str());
+}
+
+// Re-reads one folder after an event and reconciles the index with it:
+// the change in its own files goes up the ancestor chain, removed
+// subfolders are subtracted and new ones scanned and added.
+void SizeIndex::syncDir(const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mDirs.find(path) == mDirs.end())
+            return;
+    }
+    DirNode fresh;
+    if (!scanDir(path, fresh))
+        return;
+    std::vector<std::string> added;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto itr = mDirs.find(path);
+        if (itr == mDirs.end())
+            return;
+        addTotals(path, fresh.mOwnBytes - itr->second.mOwnBytes, fresh.mOwnFiles - itr->second.mOwnFiles);
+        itr->second.mOwnBytes = fresh.mOwnBytes;
+        itr->second.mOwnFiles = fresh.mOwnFiles;
+        std::vector<std::string> removed;
+        std::set_difference(itr->second.mChildren.begin(), itr->second.mChildren.end(),
+            fresh.mChildren.begin(), fresh.mChildren.end(), std::back_inserter(removed));
+        std::set_difference(fresh.mChildren.begin(), fresh.mChildren.end(),
+            itr->second.mChildren.begin(), itr->second.mChildren.end(), std::back_inserter(added));
+        for (auto& child : removed)
+        {
+            removeTree(path + "/" + child);
+            itr->second.mChildren.erase(child);
+        }
+    }
+    for (auto& child : added)
+    {
+        std::string childPath = path + "/" + child;
+        DirMap dirs;
+        if (!scanTree(childPath, dirs))
+            LOG_DEBUG_SAF("%s: watch limit reached under %s", __FUNCTION__, childPath.c_str());
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto itr = mDirs.find(path);
+        if ((itr == mDirs.end()) || (mDirs.find(childPath) != mDirs.end()))
+            continue;
+        uint64_t bytes = dirs[childPath].mTotalBytes;
+        uint64_t files = dirs[childPath].mTotalFiles;
+        itr->second.mChildren.insert(child);
+        mDirs.merge(dirs);
+        addTotals(path, bytes, files);
+    }
+}
+
+void SizeIndex::eventLoop()
+{
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    while (true)
+    {
+        ssize_t len = read(mInotifyFd, buffer, sizeof(buffer));
+        if (len <= 0)
+        {
+            if ((len < 0) && (errno == EINTR))
+                continue;
+            LOG_DEBUG_SAF("%s: inotify read failed: %s", __FUNCTION__, strerror(errno));
+            return;
+        }
+        std::set<std::string> dirty;
+        std::vector<std::string> rebuild;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            for (char *ptr = buffer; ptr < buffer + len;)
+            {
+                struct inotify_event *event = reinterpret_cast<struct inotify_event *>(ptr);
+                ptr += sizeof(struct inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    // Events were lost: every root has to be scanned again
+                    for (auto& root : mRoots)
+                        rebuild.push_back(root.first);
+                    continue;
+                }
+                auto watch = mWatches.find(event->wd);
+                if (watch == mWatches.end())
+                    continue;
+                std::string path = watch->second;
+                std::string root = findRoot(path);
+                if ((event->mask & IN_UNMOUNT) || ((event->mask & IN_IGNORED) && (path == root)))
+                {
+                    if (!root.empty())
+                        dropRoot(root);
+                    continue;
+                }
+                if (event->mask & IN_IGNORED)
+                {
+                    // The folder itself is gone; its parent's event removes it
+                    mWatches.erase(watch);
+                    continue;
+                }
+                if (root.empty())
+                    continue;
+                if (mRoots[root].mState == IndexState::BUILDING)
+                    mRoots[root].mDirty.insert(path);
+                else if (mRoots[root].mState == IndexState::READY)
+                    dirty.insert(path);
+            }
+            for (auto& root : rebuild)
+                dropRoot(root);
+        }
+        // Parents first, so a removed subtree is gone before its children sync
+        for (auto& path : dirty)
+            syncDir(path);
+        for (auto& root : rebuild)
+            addRoot(root);
+    }
+}
+
+std::string SizeIndex::findRoot(const std::string& path)
+{
+    std::string found;
+    for (auto& root : mRoots)
+    {
+        const std::string& rootPath = root.first;
+        if ((path.compare(0, rootPath.size(), rootPath) == 0)
+            && ((path.size() == rootPath.size()) || (path[rootPath.size()] == '/'))
+            && (rootPath.size() > found.size()))
+            found = rootPath;
+    }
+    return found;
+}
+
+// Adds signed deltas (as wrapping unsigned values) to path and every
+// ancestor up to its root
+void SizeIndex::addTotals(std::string path, uint64_t bytes, uint64_t files)
+{
+    if ((bytes == 0) && (files == 0))
+        return;
+    std::string root = findRoot(path);
+    while (true)
+    {
+        auto itr = mDirs.find(path);
+        if (itr != mDirs.end())
+        {
+            itr->second.mTotalBytes += bytes;
+            itr->second.mTotalFiles += files;
+        }
+        if ((path == root) || root.empty())
+            break;
+        path = getParent(path);
+    }
+}
+
+void SizeIndex::removeTree(const std::string& path)
+{
+    auto itr = mDirs.find(path);
+    if (itr == mDirs.end())
+        return;
+    addTotals(getParent(path), 0 - itr->second.mTotalBytes, 0 - itr->second.mTotalFiles);
+    std::vector<std::string> pending = { path };
+    while (!pending.empty())
+    {
+        std::string dirPath = std::move(pending.back());
+        pending.pop_back();
+        auto dir = mDirs.find(dirPath);
+        if (dir == mDirs.end())
+            continue;
+        for (auto& child : dir->second.mChildren)
+            pending.push_back(dirPath + "/" + child);
+        unwatch(dirPath, dir->second.mWd);
+        mDirs.erase(dir);
+    }
+}
+
+void SizeIndex::dropRoot(const std::string& root)
+{
+    std::string prefix = root + "/";
+    for (auto itr = mDirs.begin(); itr != mDirs.end();)
+    {
+        if ((itr->first == root) || (itr->first.compare(0, prefix.size(), prefix) == 0))
+        {
+            unwatch(itr->first, itr->second.mWd);
+            itr = mDirs.erase(itr);
+        }
+        else
+            ++itr;
+    }
+    mRoots.erase(root);
+    LOG_DEBUG_SAF("%s: %s dropped", __FUNCTION__, root.c_str());
+}
+
+void SizeIndex::unwatch(const std::string& path, int wd)
+{
+    // A folder moved inside the index keeps its watch under the new path
+    auto watch = mWatches.find(wd);
+    if ((watch == mWatches.end()) || (watch->second != path))
+        return;
+    mWatches.erase(watch);
+    inotify_rm_watch(mInotifyFd, wd);
+}
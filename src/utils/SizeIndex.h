@@ -0,0 +1,85 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#ifndef _SIZE_INDEX_H_
+#define _SIZE_INDEX_H_
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <pbnjson.hpp>
+
+enum class IndexState
+{
+    BUILDING, READY, FAILED
+};
+
+/*
+ * Recursive byte and file totals for every folder under the registered
+ * storage roots (internal storage and mounted USB drives). A root is first
+ * scanned in the background, its top-level folders on several bulk workers;
+ * after that, inotify events mark folders dirty and only those folders are
+ * re-read, with the difference pushed up to every ancestor. A lookup is then
+ * a single hash probe. Folders whose root is still building, or could not
+ * be indexed (network mounts, inotify watch limit), are not answered here.
+ */
+class SizeIndex
+{
+public:
+    static SizeIndex& getInstance();
+    void addRoot(const std::string& path);
+    bool getTotals(const std::string& path, uint64_t& bytes, uint64_t& files);
+    pbnjson::JValue toJson();
+
+private:
+    struct DirNode
+    {
+        uint64_t mOwnBytes = 0;
+        uint64_t mOwnFiles = 0;
+        uint64_t mTotalBytes = 0;
+        uint64_t mTotalFiles = 0;
+        int mWd = -1;
+        std::set<std::string> mChildren;
+    };
+    typedef std::unordered_map<std::string, DirNode> DirMap;
+
+    struct Root
+    {
+        IndexState mState;
+        std::set<std::string> mDirty;
+    };
+
+    SizeIndex();
+    SizeIndex(const SizeIndex&) = delete;
+    SizeIndex& operator=(const SizeIndex&) = delete;
+    bool scanDir(const std::string& path, DirNode& node);
+    bool scanTree(const std::string& path, DirMap& dirs);
+    void buildRoot(std::string root);
+    void syncDir(const std::string& path);
+    void eventLoop();
+    std::string findRoot(const std::string& path);
+    void addTotals(std::string path, uint64_t bytes, uint64_t files);
+    void removeTree(const std::string& path);
+    void dropRoot(const std::string& root);
+    void unwatch(const std::string& path, int wd);
+
+    std::mutex mMutex;
+    int mInotifyFd;
+    std::map<std::string, Root> mRoots;
+    DirMap mDirs;
+    std::unordered_map<int, std::string> mWatches;
+};
+
+#endif /* _SIZE_INDEX_H_ */
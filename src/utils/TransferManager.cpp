@@ -0,0 +1,351 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#include <vector>
+#include "SAFLog.h"
+#include "TransferManager.h"
+
+#define SAF_DEFAULT_PROGRESS_INTERVAL_MS 1000
+#define SAF_MIN_PROGRESS_INTERVAL_MS 100
+#define SAF_MAX_FINISHED_JOBS 16
+
+TransferJob::TransferJob(std::string jobId, MethodType type, std::string srcPath,
+    std::string destPath, uint32_t intervalMs, Emitter emitter, std::string sessionId)
+    : mJobId(std::move(jobId)), mType(type), mSrcPath(std::move(srcPath)),
+      mDestPath(std::move(destPath)), mSessionId(std::move(sessionId)), mInterval(intervalMs), mEmitter(std::move(emitter)),
+      mFinished(false), mState(JobState::QUEUED), mErrorCode(0), mPausedTime(0),
+      mBytesDone(0), mBytesTotal(0), mFilesDone(0), mFilesTotal(0)
+{
+}
+
+JobState TransferJob::getState()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mState;
+}
+
+bool TransferJob::isFinished()
+{
+    JobState state = getState();
+    return ((state == JobState::CANCELLED) || (state == JobState::COMPLETED) || (state == JobState::FAILED));
+}
+
+bool TransferJob::start()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mState != JobState::QUEUED)
+            return false;
+        mState = JobState::RUNNING;
+        mStartTime = std::chrono::steady_clock::now();
+        mLastEmit = mStartTime;
+    }
+    emit(true);
+    return true;
+}
+
+bool TransferJob::checkpoint()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondVar.wait(lock, [this] { return (mState != JobState::PAUSED); });
+    return (mState == JobState::RUNNING);
+}
+
+void TransferJob::setTotal(uint64_t bytes, uint64_t files)
+{
+    mBytesTotal = bytes;
+    mFilesTotal = files;
+}
+
+void TransferJob::addProgress(uint64_t bytes, uint64_t files)
+{
+    mBytesDone += bytes;
+    mFilesDone += files;
+    emit(false);
+}
+
+bool TransferJob::pause()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mState != JobState::RUNNING)
+            return false;
+        mState = JobState::PAUSED;
+        mPausedAt = std::chrono::steady_clock::now();
+    }
+    emit(true);
+    return true;
+}
+
+bool TransferJob::resume()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mState != JobState::PAUSED)
+            return false;
+        mState = JobState::RUNNING;
+        mPausedTime += std::chrono::steady_clock::now() - mPausedAt;
+    }
+    mCondVar.notify_all();
+    emit(true);
+    return true;
+}
+
+bool TransferJob::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if ((mState == JobState::CANCELLED) || (mState == JobState::COMPLETED)
+            || (mState == JobState::FAILED))
+            return false;
+        if (mState == JobState::PAUSED)
+            mPausedTime += std::chrono::steady_clock::now() - mPausedAt;
+        mState = JobState::CANCELLED;
+    }
+    // The engine stops at its next checkpoint and the final event is
+    // sent when the provider replies.
+    mCondVar.notify_all();
+    return true;
+}
+
+pbnjson::JValue TransferJob::finish(pbnjson::JValue result)
+{
+    {
+        std::lock_guard<std::mutex> emitLock(mEmitMutex);
+        std::lock_guard<std::mutex> lock(mMutex);
+        if ((mState == JobState::QUEUED) || (mState == JobState::RUNNING) || (mState == JobState::PAUSED))
+        {
+            if (result.hasKey("returnValue") && result["returnValue"].asBool())
+            {
+                mState = JobState::COMPLETED;
+            }
+            else
+            {
+                mState = JobState::FAILED;
+                if (result.hasKey("errorCode"))
+                    result["errorCode"].asNumber<int>(mErrorCode);
+                if (result.hasKey("errorText"))
+                    mErrorText = result["errorText"].asString();
+            }
+        }
+        // No further events once the final reply is out
+        mFinished = true;
+        mEmitter = nullptr;
+    }
+    mCondVar.notify_all();
+    pbnjson::JValue status = toJson();
+    result.put("jobId", mJobId);
+    result.put("state", status["state"]);
+    result.put("progress", status["progress"]);
+    result.put("bytesDone", status["bytesDone"]);
+    result.put("bytesTotal", status["bytesTotal"]);
+    result.put("filesDone", status["filesDone"]);
+    result.put("filesTotal", status["filesTotal"]);
+    return result;
+}
+
+pbnjson::JValue TransferJob::toJson()
+{
+    JobState state;
+    std::chrono::steady_clock::duration active(0);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        state = mState;
+        if (state != JobState::QUEUED)
+        {
+            auto end = (state == JobState::PAUSED) ? mPausedAt : std::chrono::steady_clock::now();
+            active = end - mStartTime - mPausedTime;
+        }
+    }
+    uint64_t bytesDone = mBytesDone;
+    uint64_t bytesTotal = mBytesTotal;
+    uint64_t filesDone = mFilesDone;
+    uint64_t filesTotal = mFilesTotal;
+    int progress = 0;
+    if (state == JobState::COMPLETED)
+        progress = 100;
+    else if (bytesTotal > 0)
+        progress = (int)((bytesDone >= bytesTotal) ? 100 : (bytesDone * 100 / bytesTotal));
+    else if (filesTotal > 0)
+        progress = (int)((filesDone >= filesTotal) ? 100 : (filesDone * 100 / filesTotal));
+
+    double seconds = std::chrono::duration<double>(active).count();
+    uint64_t throughput = (seconds > 0) ? (uint64_t)(bytesDone / seconds) : 0;
+    int64_t eta = -1;
+    if ((throughput > 0) && (bytesTotal >= bytesDone))
+        eta = (int64_t)((bytesTotal - bytesDone) / throughput);
+
+    pbnjson::JValue respObj = pbnjson::Object();
+    respObj.put("returnValue", true);
+    respObj.put("jobId", mJobId);
+    respObj.put("type", getTypeString(mType));
+    respObj.put("srcPath", mSrcPath);
+    respObj.put("destPath", mDestPath);
+    respObj.put("state", getStateString(state));
+    respObj.put("progress", progress);
+    respObj.put("bytesDone", (int64_t)bytesDone);
+    respObj.put("bytesTotal", (int64_t)bytesTotal);
+    respObj.put("filesDone", (int64_t)filesDone);
+    respObj.put("filesTotal", (int64_t)filesTotal);
+    respObj.put("throughput", (int64_t)throughput);
+    respObj.put("eta", eta);
+    if (state == JobState::FAILED)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        respObj.put("errorCode", mErrorCode);
+        respObj.put("errorText", mErrorText);
+    }
+    return respObj;
+}
+
+void TransferJob::emit(bool force)
+{
+    // A periodic update is skipped rather than queued behind one being sent,
+    // so copy streams never wait on the bus
+    std::unique_lock<std::mutex> emitLock(mEmitMutex, std::defer_lock);
+    if (force)
+        emitLock.lock();
+    else if (!emitLock.try_lock())
+        return;
+    if (mFinished || !mEmitter)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto now = std::chrono::steady_clock::now();
+        if (!force && ((now - mLastEmit) < mInterval))
+            return;
+        mLastEmit = now;
+    }
+    mEmitter(toJson());
+}
+
+std::string TransferJob::getTypeString(MethodType type)
+{
+    switch(type)
+    {
+        case MethodType::MOVE_METHOD:   return "move";
+        case MethodType::REMOVE_METHOD: return "remove";
+        default:                        return "copy";
+    }
+}
+
+std::string TransferJob::getStateString(JobState state)
+{
+    switch(state)
+    {
+        case JobState::QUEUED:      return "queued";
+        case JobState::RUNNING:     return "running";
+        case JobState::PAUSED:      return "paused";
+        case JobState::CANCELLED:   return "cancelled";
+        case JobState::COMPLETED:   return "completed";
+        case JobState::FAILED:      return "failed";
+    }
+    return "unknown";
+}
+
+TransferManager::TransferManager() : mNextJobId(0)
+{
+}
+
+TransferManager& TransferManager::getInstance()
+{
+    static TransferManager obj;
+    return obj;
+}
+
+std::shared_ptr<TransferJob> TransferManager::createJob(std::shared_ptr<RequestData> reqData, bool withEvents)
+{
+    int interval = SAF_DEFAULT_PROGRESS_INTERVAL_MS;
+    if (reqData->params.hasKey("progressInterval"))
+        reqData->params["progressInterval"].asNumber<int>(interval);
+    if (interval < SAF_MIN_PROGRESS_INTERVAL_MS)
+        interval = SAF_MIN_PROGRESS_INTERVAL_MS;
+
+    auto cb = reqData->cb;
+    auto subs = reqData->subs;
+    TransferJob::Emitter emitter = nullptr;
+    if (withEvents)
+        emitter = [cb, subs](pbnjson::JValue obj) { cb(std::move(obj), subs); };
+    std::shared_ptr<TransferJob> job;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        pruneFinishedJobs();
+        std::string jobId = std::to_string(++mNextJobId);
+        // A remove has one path and no destination
+        std::string srcPath = reqData->params.hasKey("srcPath")
+            ? reqData->params["srcPath"].asString() : reqData->params["path"].asString();
+        std::string destPath = reqData->params.hasKey("destPath") ? reqData->params["destPath"].asString() : "";
+        job = std::make_shared<TransferJob>(jobId, reqData->methodType, std::move(srcPath), std::move(destPath),
+            (uint32_t)interval, std::move(emitter), reqData->sessionId);
+        mJobs[jobId] = job;
+        mJobOrder.push_back(std::move(jobId));
+    }
+    reqData->params.put("jobId", job->getJobId());
+
+    // Events from the job already carry its id. Anything else is the
+    // provider's final reply and closes the job.
+    reqData->cb = [job, cb](pbnjson::JValue obj, std::shared_ptr<LSUtils::ClientWatch> subs)
+        {
+            if (!obj.hasKey("jobId"))
+                obj = job->finish(std::move(obj));
+            cb(std::move(obj), std::move(subs));
+        };
+    LOG_DEBUG_SAF("%s: job %s created", __FUNCTION__, job->getJobId().c_str());
+    return job;
+}
+
+std::shared_ptr<TransferJob> TransferManager::getJob(const std::string& jobId)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto itr = mJobs.find(jobId);
+    if (itr == mJobs.end())
+        return nullptr;
+    return itr->second;
+}
+
+pbnjson::JValue TransferManager::listJobs(const std::string& sessionId)
+{
+    std::vector<std::shared_ptr<TransferJob>> jobs;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto& jobId : mJobOrder)
+        {
+            if (mJobs[jobId]->getSessionId() == sessionId)
+                jobs.push_back(mJobs[jobId]);
+        }
+    }
+    pbnjson::JValue jobsArr = pbnjson::Array();
+    for (auto& job : jobs)
+        jobsArr.append(job->toJson());
+    return jobsArr;
+}
+
+void TransferManager::pruneFinishedJobs()
+{
+    size_t finished = 0;
+    for (auto& jobId : mJobOrder)
+    {
+        if (mJobs[jobId]->isFinished())
+            ++finished;
+    }
+    for (auto itr = mJobOrder.begin(); (finished > SAF_MAX_FINISHED_JOBS) && (itr != mJobOrder.end());)
+    {
+        if (mJobs[*itr]->isFinished())
+        {
+            mJobs.erase(*itr);
+            itr = mJobOrder.erase(itr);
+            --finished;
+        }
+        else
+            ++itr;
+    }
+}
@@ -0,0 +1,118 @@
+/* @@@LICENSE
+ *
+ * Copyright (c) 2024 LG Electronics, Inc.
+ *
+ * Confidential computer software. Valid license from LG required for
+ * possession, use or copying. Consistent with FAR 12.211 and 12.212,
+ * Commercial Computer Software, Computer Software Documentation, and
+ * Technical Data for Commercial Items are licensed to the U.S. Government
+ * under vendor's standard commercial license.
+ *
+ * LICENSE@@@ */
+
+#ifndef _TRANSFER_MANAGER_H_
+#define _TRANSFER_MANAGER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <pbnjson.hpp>
+#include "SA_Common.h"
+
+enum class JobState
+{
+    QUEUED, RUNNING, PAUSED, CANCELLED, COMPLETED, FAILED
+};
+
+/*
+ * One copy/move/remove request. The engine reports progress into the job and
+ * calls checkpoint() between files; the job turns that into progress events
+ * for the client, rate limited to the interval the client asked for. A
+ * remove counts entries only, so its progress is taken from the file counts.
+ */
+class TransferJob
+{
+public:
+    typedef std::function<void(pbnjson::JValue)> Emitter;
+
+    TransferJob(std::string jobId, MethodType type, std::string srcPath,
+        std::string destPath, uint32_t intervalMs, Emitter emitter, std::string sessionId = "");
+    std::string getJobId() { return mJobId; }
+    // The session that started the job; only it may see or control the job
+    std::string getSessionId() { return mSessionId; }
+    MethodType getType() { return mType; }
+    JobState getState();
+    bool isFinished();
+
+    bool start();
+    bool checkpoint();
+    void setTotal(uint64_t bytes, uint64_t files);
+    void addProgress(uint64_t bytes, uint64_t files);
+    bool pause();
+    bool resume();
+    bool cancel();
+    pbnjson::JValue finish(pbnjson::JValue result);
+    pbnjson::JValue toJson();
+
+private:
+    void emit(bool force);
+    static std::string getStateString(JobState state);
+    static std::string getTypeString(MethodType type);
+
+    std::string mJobId;
+    MethodType mType;
+    std::string mSrcPath;
+    std::string mDestPath;
+    std::string mSessionId;
+    std::chrono::milliseconds mInterval;
+    Emitter mEmitter;
+    // Held across each event, so finish() waits out one in flight and no
+    // event follows the final reply; taken before mMutex
+    std::mutex mEmitMutex;
+    bool mFinished;
+
+    std::mutex mMutex;
+    std::condition_variable mCondVar;
+    JobState mState;
+    int mErrorCode;
+    std::string mErrorText;
+    std::chrono::steady_clock::time_point mStartTime;
+    std::chrono::steady_clock::time_point mLastEmit;
+    std::chrono::steady_clock::duration mPausedTime;
+    std::chrono::steady_clock::time_point mPausedAt;
+
+    std::atomic<uint64_t> mBytesDone;
+    std::atomic<uint64_t> mBytesTotal;
+    std::atomic<uint64_t> mFilesDone;
+    std::atomic<uint64_t> mFilesTotal;
+};
+
+class TransferManager
+{
+public:
+    static TransferManager& getInstance();
+    // Without events the caller gets only the final reply, which carries the job id
+    std::shared_ptr<TransferJob> createJob(std::shared_ptr<RequestData> reqData, bool withEvents = true);
+    std::shared_ptr<TransferJob> getJob(const std::string& jobId);
+    // The jobs started by one session
+    pbnjson::JValue listJobs(const std::string& sessionId);
+
+private:
+    TransferManager();
+    TransferManager(const TransferManager&) = delete;
+    TransferManager& operator=(const TransferManager&) = delete;
+    void pruneFinishedJobs();
+
+    std::mutex mMutex;
+    uint64_t mNextJobId;
+    std::map<std::string, std::shared_ptr<TransferJob>> mJobs;
+    std::deque<std::string> mJobOrder;
+};
+
+#endif /* _TRANSFER_MANAGER_H_ */